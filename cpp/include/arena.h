@@ -0,0 +1,73 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+constexpr size_t ARENA_DEFAULT_SLAB_SIZE = 1 << 20;
+
+// bump allocator that hands out memory from large slabs and frees everything
+// at once. used for the search tree so a search costs a few slab allocations
+// rather than one per node, and throwing the tree away doesn't free nodes one
+// by one. slabs are kept after release() so the next search reuses them.
+// NOTE: not thread-safe
+class Arena {
+  public:
+    Arena(size_t slab_size = ARENA_DEFAULT_SLAB_SIZE) : slab_size(slab_size) {}
+    ~Arena();
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // constructs a T in the arena. its destructor is run by release() unless
+    // it is trivially destructible, in which case release() is O(1)
+    template <typename T, typename... Args>
+    T* create(Args&&... args) {
+      T* obj = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+      if constexpr (!std::is_trivially_destructible_v<T>) {
+        destructors.emplace_back(obj, [](void* ptr) { static_cast<T*>(ptr)->~T(); });
+      }
+      return obj;
+    }
+
+    // returns n value-initialised Ts, which must be trivially destructible
+    template <typename T>
+    std::span<T> createArray(size_t n) {
+      static_assert(std::is_trivially_destructible_v<T>, "arena arrays aren't destroyed");
+      T* arr = static_cast<T*>(allocate(n * sizeof(T), alignof(T)));
+      std::uninitialized_value_construct_n(arr, n);
+      return std::span<T>(arr, n);
+    }
+
+    // destroys every object in the arena and makes all of its memory
+    // available again, keeping the slabs
+    void release();
+
+    // bytes handed out since the last release()
+    size_t bytesUsed() const;
+    // bytes held in slabs, used or not
+    size_t bytesReserved() const;
+
+  private:
+    struct Slab {
+      std::unique_ptr<std::byte[]> data;
+      size_t size;
+    };
+
+    void* allocate(size_t size, size_t alignment);
+
+    size_t slab_size;
+    std::vector<Slab> slabs;
+    // slab currently being allocated from and the offset into it
+    size_t cur_slab = 0;
+    size_t offset = 0;
+    size_t bytes_used = 0;
+    size_t bytes_reserved = 0;
+    std::vector<std::pair<void*, void (*)(void*)>> destructors;
+};
+
+#endif // ARENA_H
@@ -0,0 +1,52 @@
+#ifndef ENCODING_H
+#define ENCODING_H
+
+#include <array>
+
+#include "position.h"
+
+// shape of BlunderNet's input and policy output. kept free of torch so every
+// net implementation encodes positions and decodes moves identically
+constexpr int N_PIECE_PLANES = 12;
+// current position + history, castling rights, side to move and a plane of 1s
+constexpr int N_INPUT_PLANES = (N_PIECE_PLANES * (POS_HISTORY_LEN + 1)) + 4 + 1 + 1;
+constexpr int N_SQUARES = 64;
+// source * dest + promotions
+constexpr int N_POLICY_OUTPUTS = (64 * 64) + (2 * 8 * 8 * 4);
+// packed plane with every square set
+constexpr BoardBits ALL_SQUARES = ~static_cast<BoardBits>(0);
+
+// a position's 12 packed piece planes as seen by each side, indexed by the
+// colour to move in the position being encoded. the history planes of a
+// position are just its ancestors' planes so callers can compute these once
+// per position and reuse them for every descendant
+struct PiecePlanes {
+  std::array<std::array<BoardBits, N_PIECE_PLANES>, 2> by_perspective;
+};
+
+// piece planes for a position followed by its POS_HISTORY_LEN ancestors,
+// nullptr where the history runs out
+using InputHistory = std::array<const PiecePlanes*, POS_HISTORY_LEN + 1>;
+
+PiecePlanes encodePiecePlanes(const Position& pos);
+
+// writes the input for pos as N_INPUT_PLANES packed planes, one 64-bit word
+// per plane with bit i set if square i of the plane is 1. the board is
+// flipped so the side to move is always at the bottom
+void encodePackedInput(const Position& pos, BoardBits* packed_planes);
+
+// as above but copies the piece planes from history instead of deriving
+// them, history[0] being pos's own planes
+void encodePackedInput(const Position& pos, const InputHistory& history, BoardBits* packed_planes);
+
+// expands N_INPUT_PLANES packed planes into N_INPUT_PLANES * N_SQUARES floats
+void unpackPlanes(const BoardBits* packed_planes, float* planes);
+
+// writes the N_INPUT_PLANES * N_SQUARES input floats for pos into planes
+void encodeInputPlanes(const Position& pos, float* planes);
+
+// converts an index into the policy head output into a move from pos,
+// undoing the board flip if black is to move
+Move policyIndexToMove(int index, const Position& pos);
+
+#endif // ENCODING_H
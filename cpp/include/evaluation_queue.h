@@ -0,0 +1,80 @@
+#ifndef EVALUATION_QUEUE_H
+#define EVALUATION_QUEUE_H
+
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <span>
+#include <vector>
+
+#include "net.h"
+
+// return type of a coroutine that starts straight away and frees itself once
+// it finishes, so nothing has to hold on to it. used for simulations that
+// suspend on an EvaluationQueue
+struct DetachedCoroutine {
+  struct promise_type {
+    DetachedCoroutine get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    // nothing resumes a detached coroutine expecting an exception back
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+// lets coroutines on one thread wait for the net. a coroutine co_awaits
+// evaluate() and is resumed once its position has been evaluated as part of
+// a batch, so a single thread can keep many simulations in flight
+class EvaluationQueue {
+  public:
+    struct EvaluationAwaiter {
+      bool await_ready() const noexcept { return false; }
+      void await_suspend(std::coroutine_handle<> handle);
+      // valid until the coroutine next suspends
+      BatchEntry& await_resume();
+
+      EvaluationQueue& queue;
+      const Position& pos;
+      const BoardBits* packed_planes;
+      size_t index = 0;
+    };
+
+    struct RetryAwaiter {
+      bool await_ready() const noexcept { return false; }
+      void await_suspend(std::coroutine_handle<> handle);
+      void await_resume() {}
+
+      EvaluationQueue& queue;
+    };
+
+    // suspends until pos, encoded as packed_planes, has been evaluated. both
+    // must outlive the suspension, e.g. by living in the coroutine's frame
+    EvaluationAwaiter evaluate(const Position& pos, const BoardBits* packed_planes);
+    // suspends until the next batch has been evaluated
+    RetryAwaiter nextBatch();
+
+    // positions waiting for the next batch
+    int size() const;
+    // coroutines suspended on the queue, waiting for the net or a retry
+    int inFlight() const;
+    // true if no coroutines are suspended on the queue
+    bool empty() const;
+
+    // calls evaluate_batch on the waiting positions then resumes the
+    // coroutines waiting for them, followed by the ones waiting for the
+    // batch to finish. anything that suspends again waits for the next call
+    void runBatch(const std::function<void(std::span<BatchEntry>)>& evaluate_batch);
+
+  private:
+    std::vector<BatchEntry> waiting;
+    std::vector<std::coroutine_handle<>> waiting_handles;
+    std::vector<std::coroutine_handle<>> retrying;
+    // the batch being resumed, kept apart so coroutines can queue up the
+    // next batch while it is
+    std::vector<BatchEntry> evaluated;
+    std::vector<std::coroutine_handle<>> evaluated_handles;
+    std::vector<std::coroutine_handle<>> resuming;
+};
+
+#endif // EVALUATION_QUEUE_H
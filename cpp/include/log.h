@@ -0,0 +1,50 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <cstdio>
+
+// search logging, written to stderr so it never mixes with UCI on stdout.
+// BLUNDER_LOG_LEVEL is the most verbose level compiled in. the macros of
+// levels below it expand to nothing, so their arguments aren't even
+// evaluated and disabled logs cost nothing
+//
+// the levels start at 1 because #if reads an undefined name as 0, so a
+// misspelt level such as BLUNDER_LOG_TRAC is caught below instead of quietly
+// meaning the most verbose one
+#define BLUNDER_LOG_TRACE 1
+#define BLUNDER_LOG_DEBUG 2
+#define BLUNDER_LOG_INFO 3
+#define BLUNDER_LOG_OFF 4
+
+// off unless asked for, so tests and UCI games don't print a summary of
+// every search
+#ifndef BLUNDER_LOG_LEVEL
+#define BLUNDER_LOG_LEVEL BLUNDER_LOG_OFF
+#endif
+
+#if BLUNDER_LOG_LEVEL < BLUNDER_LOG_TRACE || BLUNDER_LOG_LEVEL > BLUNDER_LOG_OFF
+#error "BLUNDER_LOG_LEVEL must be one of BLUNDER_LOG_TRACE, BLUNDER_LOG_DEBUG, BLUNDER_LOG_INFO or BLUNDER_LOG_OFF"
+#endif
+
+// every candidate move as sequential halving scores it
+#if BLUNDER_LOG_LEVEL <= BLUNDER_LOG_TRACE
+#define LOG_TRACE(...) std::fprintf(stderr, __VA_ARGS__)
+#else
+#define LOG_TRACE(...) do {} while (0)
+#endif
+
+// progress through a search, e.g. each sequential halving round
+#if BLUNDER_LOG_LEVEL <= BLUNDER_LOG_DEBUG
+#define LOG_DEBUG(...) std::fprintf(stderr, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do {} while (0)
+#endif
+
+// one summary per search
+#if BLUNDER_LOG_LEVEL <= BLUNDER_LOG_INFO
+#define LOG_INFO(...) std::fprintf(stderr, __VA_ARGS__)
+#else
+#define LOG_INFO(...) do {} while (0)
+#endif
+
+#endif // LOG_H
@@ -0,0 +1,65 @@
+#ifndef NATIVE_NET_H
+#define NATIVE_NET_H
+
+#include <string>
+#include <vector>
+
+#include "net.h"
+#include "encoding.h"
+
+// a convolution or fully connected layer with any batch norm already folded
+// into its weights. weights are stored [out_size][in_size], where in_size is
+// in_channels * kernel area for convolutions
+struct NativeLayer {
+  int out_size = 0;
+  int in_size = 0;
+  std::vector<float> weights;
+  std::vector<float> bias;
+};
+
+// runs BlunderNet on the CPU without libtorch. loads the weights written by
+// python/supervised_learning/export_native_weights.py and uses AVX-512 or
+// AVX2 kernels when the compiler targets them, falling back to plain loops
+// otherwise or when simd_kernels is false.
+// NOTE: holds scratch buffers so one instance must only be used by one thread
+// at a time
+class NativeBlunderNet : public Net {
+  public:
+    NativeBlunderNet(const std::string& weights_path, bool simd_kernels = true);
+    // true if this build has the AVX-512 or AVX2 kernels
+    static bool hasSIMDKernels();
+    using Net::getEvaluation;
+    double getEvaluation(const Position& pos, const BoardBits* packed_planes, std::vector<std::pair<Move, float>>& policy) override;
+
+    // runs the residual tower and both heads on N_INPUT_PLANES * N_SQUARES
+    // encoded input floats. writes N_POLICY_OUTPUTS logits to policy_logits
+    // and returns the value head's output
+    float forward(const float* input_planes, float* policy_logits);
+
+  private:
+    // 3x3 convolution with padding 1 + bias, optional residual add and relu
+    void conv3x3(const NativeLayer& layer, const float* input, float* output, bool relu, const float* residual = nullptr);
+    // 1x1 convolution + bias + relu
+    void conv1x1(const NativeLayer& layer, const float* input, float* output);
+
+    bool simd_kernels;
+    NativeLayer input_conv;
+    std::vector<NativeLayer> res_convs;
+    NativeLayer policy_conv;
+    NativeLayer policy_fc;
+    NativeLayer value_conv;
+    NativeLayer value_fc1;
+    NativeLayer value_fc2;
+
+    // scratch buffers reused between calls to avoid allocating per evaluation
+    std::vector<float> input;
+    std::vector<float> im2col;
+    std::vector<float> trunk_a;
+    std::vector<float> trunk_b;
+    std::vector<float> policy_hidden;
+    std::vector<float> value_hidden;
+    std::vector<float> value_fc1_out;
+    std::vector<float> policy_logits;
+};
+
+#endif // NATIVE_NET_H
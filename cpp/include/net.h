@@ -1,31 +1,124 @@
 #ifndef NET_H
 #define NET_H
 
+#include <span>
 #include <vector> 
 #include <string>
+#ifdef BLUNDER_WITH_TORCH
 #include <torch/script.h>
+#endif
 
 #include "position.h"
+#include "encoding.h"
+#include "move_generator.h"
+
+// a position evaluated as part of a batch, see Net::getEvaluations
+struct BatchEntry {
+  const Position* pos = nullptr;
+  const BoardBits* packed_planes = nullptr;
+  // filled in by the net
+  double value = 0;
+  std::vector<std::pair<Move, float>> policy;
+};
 
 // NOTE: this interface will probably only be used until I have an actually trained and working net
 // interface for 2-headed neural net
 class Net {
   public:
-    // returns output of value head by value and output of policy head by reference
-    virtual double getEvaluation(const Position& pos, std::vector<std::pair<Move, float>>& policy) = 0;
+    virtual ~Net() = default;
+
+    // returns output of value head by value and output of policy head by
+    // reference. packed_planes is pos's input already encoded by the caller,
+    // see encodePackedInput
+    virtual double getEvaluation(const Position& pos, const BoardBits* packed_planes, std::vector<std::pair<Move, float>>& policy) = 0;
+
+    // as above but encodes pos itself, walking its parents for the history
+    double getEvaluation(const Position& pos, std::vector<std::pair<Move, float>>& policy) {
+      BoardBits packed_planes[N_INPUT_PLANES];
+      encodePackedInput(pos, packed_planes);
+      return getEvaluation(pos, packed_planes, policy);
+    }
+
+    // fills the value and policy of every entry in batch. nets that can
+    // evaluate a batch in one forward pass override this, by default the
+    // entries are evaluated one at a time
+    virtual void getEvaluations(std::span<BatchEntry> batch) {
+      for (BatchEntry& entry : batch) {
+        entry.value = getEvaluation(*entry.pos, entry.packed_planes, entry.policy);
+      }
+    }
+
+    // whether several threads may call getEvaluation at once. the search
+    // serialises calls into nets that aren't
+    virtual bool isThreadSafe() const { return false; }
+};
+
+enum DummyPriors {
+  Uniform,
+  // weights captures and promotions by the value of the piece won
+  CaptureBiased,
 };
 
+// deterministic stand-in for BlunderNet that needs no model and costs next to
+// nothing, so the search can be benchmarked and profiled on its own. the value
+// is material plus piece-square tables squashed into [-1, 1] from the side to
+// move's perspective and the policy only covers pos's legal moves.
+// NOTE: ignores packed_planes
 class DummyNet : public Net {
   public:
-    double getEvaluation(const Position& pos, std::vector<std::pair<Move, float>>& policy) override;
+    DummyNet(DummyPriors priors = DummyPriors::CaptureBiased) : priors(priors) {}
+    using Net::getEvaluation;
+    double getEvaluation(const Position& pos, const BoardBits* packed_planes, std::vector<std::pair<Move, float>>& policy) override;
+    // the move generator only reads its tables once constructed
+    bool isThreadSafe() const override { return true; }
+
+    // material + piece-square score in centipawns from white's perspective
+    static int evaluateMaterial(const Position& pos);
+
+  private:
+    DummyPriors priors;
+    MoveGenerator move_gen;
 };
 
+#ifdef BLUNDER_WITH_TORCH
+struct BlunderNetOptions {
+  // set when model_path is an int8 model written by quantize_model.py
+  bool quantized = false;
+  // freeze the module and run optimize_for_inference, which folds conv+bn
+  // and lets oneDNN pick its fastest kernels
+  bool optimise = true;
+  // set when model_path takes packed int64 planes, i.e. it was exported with
+  // PackedInputBlunderNet. the bitboards are then passed through as they are
+  bool packed_input = true;
+  // pass float input in channels-last layout, which oneDNN convolutions
+  // prefer. packed input is unpacked by the model, which does the same in
+  // UnpackPlanes, see model.py
+  bool channels_last = true;
+  // thread pool sizes, 0 leaves libtorch's default
+  int intra_op_threads = 0;
+  int inter_op_threads = 0;
+  // run one forward pass at construction so the first search doesn't pay for
+  // TorchScript's profiling and oneDNN's kernel selection
+  bool warmup = true;
+};
+
+// runs a TorchScript export of BlunderNet through libtorch
 class BlunderNet : public Net {
   public:
-    BlunderNet(const std::string& model_path);
-    double getEvaluation(const Position& pos, std::vector<std::pair<Move, float>>& policy) override;
+    BlunderNet(const std::string& model_path, const BlunderNetOptions& options = BlunderNetOptions());
+    using Net::getEvaluation;
+    double getEvaluation(const Position& pos, const BoardBits* packed_planes, std::vector<std::pair<Move, float>>& policy) override;
+    // stacks the batch into one input tensor and runs a single forward pass
+    void getEvaluations(std::span<BatchEntry> batch) override;
+    // Module::forward may be called from several threads at once
+    bool isThreadSafe() const override { return true; }
   private:
+    // stacks the packed planes of n positions into an input tensor
+    torch::Tensor inputToTensor(const BoardBits* const* packed_planes, int n);
+
     torch::jit::script::Module net;
+    BlunderNetOptions options;
 };
+#endif
 
 #endif // NET_H
\ No newline at end of file
@@ -0,0 +1,51 @@
+#ifndef NN_CACHE_H
+#define NN_CACHE_H
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "position.h"
+
+constexpr size_t NN_CACHE_DEFAULT_SIZE = 1 << 18;
+constexpr size_t NN_CACHE_N_STRIPES = 64;
+
+// returns a key for the position together with the POS_HISTORY_LEN positions
+// before it. the net sees the history planes so two positions with the same
+// board but a different history can get different evaluations
+unsigned long long historyHash(const Position& pos);
+
+// fixed-size cache of net evaluations. stores the value and the renormalised
+// priors of the legal moves only, packed into 16 bit moves. slots are
+// protected by a fixed set of striped locks so many threads can share it
+class NNCache {
+  public:
+    NNCache(size_t n_entries = NN_CACHE_DEFAULT_SIZE);
+
+    // returns true and fills value and priors if key is in the cache
+    bool lookup(unsigned long long key, float& value, std::vector<std::pair<Move, float>>& priors);
+    // stores an evaluation, overwriting whatever was in the slot before
+    void insert(unsigned long long key, float value, const std::vector<std::pair<Move, float>>& priors);
+    // empties every slot
+    void clear();
+
+    size_t size() const;
+
+  private:
+    struct Entry {
+      unsigned long long key = 0;
+      bool occupied = false;
+      float value = 0;
+      std::vector<std::pair<uint16_t, float>> priors;
+    };
+
+    size_t slotIndex(unsigned long long key) const;
+    std::mutex& slotLock(size_t slot_index);
+
+    std::vector<Entry> entries;
+    std::array<std::mutex, NN_CACHE_N_STRIPES> locks;
+};
+
+#endif // NN_CACHE_H
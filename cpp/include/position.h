@@ -2,6 +2,7 @@
 #define POSITION_H 
 
 #include <array>
+#include <cstdint>
 #include <unordered_map>
 
 #include "bitboard.h"
@@ -19,8 +20,15 @@ class Move {
     // prints a more human readable move description
     void print(const Position& pos, const bool minimal=false) const;
     std::string to_string(const Position& pos, const bool minimal) const;
+    // long algebraic notation as used by UCI, e.g. e2e4, e1g1 or e7e8q
+    std::string toUCI() const;
     bool operator==(const Move& move) const;
 
+    // packs move into 16 bits: 6 bits source, 6 bits dest and 4 bits of
+    // move type/promotion flags
+    uint16_t pack() const;
+    static Move unpack(uint16_t packed);
+
     int source;
     int dest;
     MoveType move_type;
@@ -75,18 +83,32 @@ class Position {
     bool isDrawBy50Moves() const;
     bool isDrawByInsufficientMaterial() const;
     bool isDrawByRepetition() const;
+    // number of times the current position has occurred in the game so far
+    unsigned getRepetitionCount() const;
 
     // makes the given move in place
     void makeMove(const Move& move);
     // returns a new position with the given move made
     Position applyMove(const Move& move) const;
+    // as above but overwrites out, which reuses out's repetition map rather
+    // than allocating a new one
+    void applyMoveInto(const Move& move, Position& out) const;
 
     // returns a new position with white and black switched
     Position flip() const;
+    // writes this position with white and black switched into out without
+    // parsing a FEN or allocating. out has no parent and no repetition history
+    void flipInto(Position& out) const;
 
     unsigned long long getHash() const;
+    // hash of flip(), maintained incrementally so it costs nothing to read
+    unsigned long long getFlippedHash() const;
 
   private:
+    // constructs an empty position without parsing a FEN, only for flip()
+    struct Uninitialised {};
+    Position(Uninitialised);
+
     void prepareDoublePawnPush(const Move& move);
     void prepareRookMove(const Move& move);
     void makeCapture(const Move& move);
@@ -0,0 +1,48 @@
+#ifndef RECLAIMER_H
+#define RECLAIMER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "arena.h"
+
+// frees arenas holding discarded search trees on a background thread so the
+// search thread doesn't spend time tearing trees down, e.g. right before it
+// needs to play a move
+class Reclaimer {
+  public:
+    Reclaimer();
+    // frees anything still queued then stops the thread
+    ~Reclaimer();
+    Reclaimer(const Reclaimer&) = delete;
+    Reclaimer& operator=(const Reclaimer&) = delete;
+
+    // takes ownership of arena and frees it on the background thread
+    void reclaim(std::unique_ptr<Arena> arena);
+    // blocks until every arena handed over so far has been freed
+    void wait();
+
+    // totals over the reclaimer's lifetime, measured on the background thread
+    double getReclaimSeconds() const;
+    size_t getBytesReclaimed() const;
+
+  private:
+    void run();
+
+    std::mutex mutex;
+    std::condition_variable work_cv;
+    std::condition_variable idle_cv;
+    std::deque<std::unique_ptr<Arena>> queue;
+    bool busy = false;
+    bool stopping = false;
+    std::atomic<long long> reclaim_ns = 0;
+    std::atomic<size_t> bytes_reclaimed = 0;
+    // declared last so everything it uses is initialised before it starts
+    std::thread thread;
+};
+
+#endif // RECLAIMER_H
@@ -1,47 +1,225 @@
 #ifndef SEARCH_H
 #define SEARCH_H
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <unordered_map>
 #include <vector>
 #include <random>
 
+#include "arena.h"
 #include "position.h"
+#include "reclaimer.h"
+#include "thread_pool.h"
+#include "evaluation_queue.h"
 #include "move_generator.h"
 #include "net.h"
+#include "nn_cache.h"
+#include "encoding.h"
 
 // TODO: have no idea what these numbers "should" be- run some experiments
 constexpr int N_TO_CONSIDER = 16;
 constexpr int N_SIMULATIONS = 200;
 
+// progressive widening below the root: a node searches its
+// max(MIN_WIDENED_CHILDREN, ceil(WIDENING_COEFF * visits^WIDENING_EXPONENT))
+// highest prior children
+constexpr int MIN_WIDENED_CHILDREN = 2;
+constexpr float WIDENING_COEFF = 1.0;
+constexpr float WIDENING_EXPONENT = 0.5;
+
 // hyperparameters taken from Danihelka, 2022
 constexpr int C_VISIT = 50;
 constexpr double C_SCALE = 1.0;
 
-class GumbelMCTS;
+// visits a node counts as having while a simulation is in flight below it, so
+// threads searching the tree at once spread over different children
+constexpr int VIRTUAL_LOSS = 3;
 
-struct Node {
-  // TODO: find out if passing in MoveVec leads to meaningfully wasteful copying
-  Node(float raw_prior, const Position pos, const Move move, bool is_root, MoveVec unexpanded_children)
-      : raw_prior(raw_prior), pos(pos), move(move), is_root(is_root), unexpanded_children(unexpanded_children) {}
+using SearchClock = std::chrono::steady_clock;
+
+// time limited searches run simulations in chunks sized from the measured
+// simulation rate to take at most this long, checking the clock in between.
+// it roughly bounds how far they overrun their deadline
+constexpr std::chrono::milliseconds TIME_CHECK_INTERVAL{5};
+
+// deepest a simulation descends below the root. one that gets there backs up
+// the node it stopped at as if it were a leaf
+constexpr int MAX_SEARCH_DEPTH = 256;
 
-  // TODO: decide if the below is horrible and if there's a better way to do it
-  // root node constructor, will leave Move empty because we've already taken move
-  Node(const Position pos, MoveVec unexpanded_children)
-      : raw_prior(0), pos(pos), move(Move()), is_root(true),
-        unexpanded_children(unexpanded_children) {}
+enum ExpansionState : uint8_t { Unexpanded, Expanding, Expanded };
 
-  float raw_prior;
+// an edge of the search tree: the move leading to a position, its prior and
+// its search statistics. positions aren't stored, they are rebuilt by
+// replaying moves from the root, and a node's children are one contiguous
+// array in the search's arena, so nodes stay small and trivially destructible.
+// when several threads search the tree the statistics are only touched
+// through std::atomic_ref, see search.cpp
+struct Node {
+  Move getMove() const { return Move::unpack(move); }
+  std::span<Node> getChildren() const { return std::span<Node>(children, n_children); }
+  // the children progressive widening currently lets the search select
+  std::span<Node> getWidenedChildren() const { return std::span<Node>(children, n_widened); }
+  // terminal nodes count as expanded, they just have no children
+  bool isExpanded() const { return expansion_state == ExpansionState::Expanded; }
+
+  // packed, see Move::pack(). the root's move is left empty
+  uint16_t move = 0;
+  uint16_t n_children = 0;
+  // children are sorted by descending prior and only the first n_widened are
+  // searched
+  uint16_t n_widened = 0;
+  bool is_terminal = false;
+  // only the thread that moves this from Unexpanded to Expanding expands the
+  // node, see GumbelMCTS::expandAndEvaluate
+  uint8_t expansion_state = ExpansionState::Unexpanded;
+  float raw_prior = 0;
   float applied_gumbel = 0; 
-  float score;
-  int visit_count = 0;
+  float score = 0;
   float value = 0;
-  const Move move;
-  const Position pos;
-  bool is_root = false;
-  bool is_terminal = false;
+  // one per simulation through the node, added when it is backed up
+  int visit_count = 0;
+  // VIRTUAL_LOSS for every simulation currently below this node
+  int virtual_loss = 0;
+  Node* children = nullptr;
+};
+
+// a position expanded somewhere in the tree. nodes reaching the same
+// position by another path point at the same children so the search is a
+// graph and statistics below a transposition are shared, see "Monte-Carlo
+// Graph Search for AlphaZero" (Czech, 2020)
+struct TranspositionEntry {
+  Node* children;
+  uint16_t n_children;
+  float value;
+};
+
+// expanded positions keyed by their hash and repetition count
+using TranspositionTable = std::unordered_map<unsigned long long, TranspositionEntry>;
+
+// counters collected over a single call to getBestMove
+struct SearchStats {
+  int nn_evaluations = 0;
+  unsigned long long cache_lookups = 0;
+  unsigned long long cache_hits = 0;
+  int n_nodes = 0;
+  // moves left out of the tree because their prior was below MIN_POLICY_PROB
+  int n_pruned = 0;
+  // non-terminal expansions, and how many of them shared the children of a
+  // transposition rather than evaluating the position
+  int n_expansions = 0;
+  int n_transpositions = 0;
+  // legal move generations, only done when expanding a node whose
+  // evaluation isn't cached
+  int move_generations = 0;
+  // simulations below the root carried over from the previous search and
+  // the total once this search is done
+  int reused_visits = 0;
+  int total_visits = 0;
+  // tree memory, see Arena
+  size_t arena_bytes_used = 0;
+  size_t arena_bytes_reserved = 0;
+  // time the searcher's reclaimer has spent freeing discarded trees in the
+  // background, over the searcher's lifetime
+  double reclaim_seconds = 0;
+  // simulations that reached a node while another thread was expanding it
+  // and waited for it instead. in batched searches the simulation is undone
+  // and retried after the next batch
+  int n_collisions = 0;
+  // simulations run by this search, the calls into the net they took and
+  // how long the search took, to compare batch sizes
+  int n_simulations = 0;
+  int n_batches = 0;
+  double search_seconds = 0;
+  // how far a time limited search ran past its deadline
+  double deadline_overshoot_seconds = 0;
+
+  // adds other's counters to these
+  void merge(const SearchStats& other);
+  double cacheHitRate() const;
+  double transpositionRate() const;
+  double reusedVisitFraction() const;
+  double simulationsPerSecond() const;
+  double averageBatchSize() const;
+};
+
+struct SearchOptions {
+  // threads running simulations. with more than one they descend the same
+  // tree at once, see VIRTUAL_LOSS
+  int n_threads = 1;
+  // with more than one thread, run each root child sequential halving
+  // considers as one task instead of spreading every simulation over the
+  // threads. the children's subtrees are disjoint so the threads don't meet
+  // and positions are only shared within a subtree, through a table nothing
+  // else touches. rounds with fewer children than threads leave threads idle
+  bool root_parallel = false;
+  // leaves each thread gathers before evaluating them in one call to
+  // Net::getEvaluations. above 1 each thread runs its simulations as
+  // coroutines that suspend while their leaf waits for the net, so it keeps
+  // up to batch_size of them in flight. they steer apart with virtual loss
+  // like threads do
+  int batch_size = 1;
+};
+
+// what expanding a node still needs once its position has been evaluated
+struct PendingExpansion {
+  Node* node = nullptr;
+  int depth = 0;
+  // nn cache and transposition table keys
+  unsigned long long key = 0;
+  unsigned long long transposition_key = 0;
+  MoveVec legal_moves;
+};
+
+// the nodes a simulation passes through, from a child of the root down to
+// its leaf
+struct SearchPath {
+  Node* leaf() const { return nodes[size - 1]; }
+
+  std::array<Node*, MAX_SEARCH_DEPTH> nodes;
+  int size = 0;
+};
+
+enum SelectionResult {
+  // the leaf is claimed and waiting to be evaluated
+  NeedsEvaluation,
+  // the leaf is terminal or was expanded without the net
+  LeafReady,
+  // ran into a leaf someone else is waiting to evaluate and undid the
+  // descent
+  Collided,
+};
 
-  std::vector<std::unique_ptr<Node>> expanded_children;
-  MoveVec unexpanded_children;
+// what a thread needs to run simulations: the positions along the path it is
+// visiting and its own counters
+struct SearchThread {
+  // positions from the root to the node being visited, rebuilt by replaying
+  // moves on every simulation, and their piece planes. a deque so each
+  // position's parent pointer stays valid as the path grows. the planes are
+  // only encoded when a leaf is evaluated and only for the positions its
+  // input needs, see getInputHistory
+  std::deque<Position> path;
+  std::vector<PiecePlanes> path_planes;
+  SearchStats stats;
+  // nodes the thread expands are allocated here so threads don't contend
+  // for one arena. threads[0]'s also holds the root and any reused tree
+  std::unique_ptr<Arena> arena = std::make_unique<Arena>();
+  // the table of the subtree the thread is searching on its own, see
+  // SearchOptions::root_parallel. nullptr while threads share the tree
+  TranspositionTable* subtree_transpositions = nullptr;
+  // simulations suspended until their leaf has been evaluated, see
+  // SearchOptions::batch_size
+  EvaluationQueue queue;
+  // stats.n_simulations as of the last simulation, for reading while the
+  // search runs
+  std::atomic<int> progress = 0;
 };
 
 // executes Gumbel Monte Carlo Tree Search as described in "Policy Improvement
@@ -49,9 +227,38 @@ struct Node {
 // https://openreview.net/pdf?id=bERaNdoegnO
 class GumbelMCTS {
   public:
-    GumbelMCTS(Net* net, int simulation_budget) : net(net), simulation_budget(simulation_budget) {}
-    // executes Gumbel MCTS from a given position to find best move
+    // cache is optional and may be shared between searches and searchers
+    GumbelMCTS(Net* net, int simulation_budget, NNCache* cache = nullptr,
+               const SearchOptions& options = SearchOptions());
+    // executes Gumbel MCTS from a given position to find best move. if pos
+    // is the root of the previous search's tree or one of its children or
+    // grandchildren the search carries on from that subtree. if pos is mate
+    // or stalemate it returns the null move, from a1 to a1, which no legal
+    // move equals. a position that is already drawn by repetition, the
+    // fifty move rule or material is still searched and gets a legal move
     Move getBestMove(const Position& pos);
+    // as above but searches for time_budget instead of a fixed number of
+    // simulations. sequential halving gives each round an equal share of
+    // the time left
+    Move getBestMove(const Position& pos, std::chrono::milliseconds time_budget);
+    // makes getBestMove stop simulating and return the best candidate by
+    // its score so far. safe to call from any thread. stays set until
+    // clearStop(), so a stop sent just before a search starts isn't lost
+    void stop();
+    void clearStop();
+
+    // progress of a running search, safe to read from any thread. the
+    // leading candidate starts as the one with the highest prior plus gumbel
+    // noise and is updated after every sequential halving round
+    int getSimulationsSoFar() const;
+    std::optional<Move> getBestCandidate() const;
+
+    // the opponent's most visited reply to move in the tree kept from the
+    // last search, i.e. the position worth pondering on
+    std::optional<Move> getExpectedReply(const Move& move) const;
+
+    // throws away the tree kept from the previous search, e.g. for a new game
+    void resetTree();
 
     // returns k nodes with highest prior + gumbel, called in argtop in Danihelka, 2022
     std::vector<Node*> getKGumbelArgtop(std::vector<Node*>& input_nodes, int k);
@@ -60,16 +267,157 @@ class GumbelMCTS {
     // employing only a budget of n simulations
     Node* applySequentialHalving(Node* root, std::vector<Node*>& nodes_to_consider);
 
-    // runs value head on child node and expands its children
-    void expandAndEvaluate(Node* node);
+    // runs value head on node, whose position is thread.path[depth], and
+    // expands its children. if another thread is already expanding node this
+    // waits for it to finish instead
+    void expandAndEvaluate(SearchThread& thread, Node* node, int depth);
+
+    // returns true and fills value and legal_priors if the evaluation under
+    // key is cached
+    bool lookupCache(SearchThread& thread, unsigned long long key, float& value, std::vector<std::pair<Move, float>>& legal_priors);
+
+    // returns the net's value of thread.path[depth] and fills legal_priors
+    // with the renormalised priors of legal_moves, caching them under key
+    float evaluate(SearchThread& thread, int depth, unsigned long long key, const MoveVec& legal_moves, std::vector<std::pair<Move, float>>& legal_priors);
+
+    // collects the piece planes of thread.path[depth] and the positions
+    // before it for the net's history planes, encoding the planes of the
+    // at most POS_HISTORY_LEN + 1 path positions it uses.
+    // NOTE: the planes used to be kept per node and assembled incrementally.
+    // Node has no room for them now, and encoding a position takes ~70ns, so
+    // the up to 5 per evaluation are ~2% of a DummyNet simulation. a
+    // per-thread table of recently encoded planes cut the encoding 2.6x
+    // without a measurable speedup, so they are encoded every time
+    void getInputHistory(SearchThread& thread, int depth, InputHistory& history) const;
 
-    // called recursively to find unexpanded nodes and backpropagate their eval
-    // up the tree. returns value of node
-    int visit(Node* node);
+    // runs one simulation from the root through child: selects down to an
+    // unexpanded node, expands and evaluates it, then backs its value up.
+    // returns the value of child
+    float visit(SearchThread& thread, Node* child);
+
+    const SearchStats& getStats() const;
   private:
     MoveGenerator move_gen;
     Net* net;
     int simulation_budget;
+    // set for time limited searches
+    std::optional<SearchClock::time_point> deadline;
+    // in time limited searches no simulation starts after this, the end of
+    // the current sequential halving round
+    SearchClock::time_point simulation_end;
+    std::atomic<bool> stop_requested = false;
+    // packed move of the leading candidate, or -1
+    std::atomic<int> best_candidate = -1;
+    // simulations run by runAndMeasureSimulations this search and how long
+    // they took
+    int measured_simulations = 0;
+    double measured_seconds = 0;
+    NNCache* cache;
+    // merged from the threads' counters at the end of each search
+    SearchStats stats;
+    // threads[0] belongs to the thread calling getBestMove, which also does
+    // everything outside of simulations. pool is only there with more than
+    // one thread
+    std::vector<std::unique_ptr<SearchThread>> threads;
+    std::unique_ptr<ThreadPool> pool;
+    bool root_parallel;
+    int batch_size;
+    // guards transpositions while simulations run
+    std::mutex transpositions_mutex;
+    // serialises calls into a net that isn't thread safe
+    std::mutex net_mutex;
+    // the tree lives in the threads' arenas. when it is reused the kept
+    // subtree is copied into a new arena and the old ones go to the
+    // reclaimer
+    Reclaimer reclaimer;
+    TranspositionTable transpositions;
+    // a table per root child for root parallel searches
+    std::unordered_map<const Node*, TranspositionTable> subtree_transpositions;
+    // root of the previous search's tree and its position
+    Node* tree_root = nullptr;
+    Position tree_pos;
+    // returns the node for pos in the previous search's tree, nullptr if
+    // there isn't one
+    Node* findSubtree(const Position& pos);
+    // moves pos's subtree from the previous search into a fresh arena and
+    // frees the rest of the tree. returns the new root or nullptr if pos
+    // isn't in the tree
+    Node* reuseTree(const Position& pos);
+    // hands the current tree to the reclaimer and starts new arenas
+    void discardTree();
+    // makes sure the root has a child for every legal move and searches them
+    // all
+    void widenRoot(Node* root);
+
+    // runs n_visits simulations through each of children, which are the
+    // root's, spread over the threads. returns once they are all done
+    void runSimulations(Node* root, const std::vector<Node*>& children, int n_visits);
+
+    // runSimulations, also measuring the rate simulations run at
+    void runAndMeasureSimulations(Node* root, const std::vector<Node*>& children, int n_visits);
+
+    // keeps running simulations through children until end, in chunks of
+    // at most TIME_CHECK_INTERVAL. the clock is also checked before each
+    // simulation so a chunk sized from a bad rate can't run far past end
+    void runSimulationsUntil(Node* root, const std::vector<Node*>& children, SearchClock::time_point end);
+
+    // true once stop() has been called during the search
+    bool stopping() const;
+    // true once no more simulations should start, i.e. on stop or, in time
+    // limited searches, once simulation_end has passed
+    bool outOfSimulations() const;
+
+    // runs the search once deadline is set up
+    Move search(const Position& pos);
+
+    // the table node expansions by thread share positions through
+    TranspositionTable& getTranspositions(SearchThread& thread);
+
+    // expandAndEvaluate once node has been claimed
+    void expandNode(SearchThread& thread, Node* node, int depth);
+
+    // expands the claimed node at thread.path[depth] as far as it can
+    // without the net. returns true, with expansion filled, if the net has
+    // to evaluate it before it can be expanded with finishExpansion
+    bool prepareExpansion(SearchThread& thread, Node* node, int depth, PendingExpansion& expansion);
+    void finishExpansion(SearchThread& thread, const PendingExpansion& expansion, float value, std::vector<std::pair<Move, float>>& legal_priors);
+
+    // runs simulations, which are the root's children to simulate through,
+    // as coroutines, evaluating their leaves batch_size at a time
+    void simulateBatched(SearchThread& thread, Node* root, std::span<Node* const> simulations);
+
+    // a simulation through child that suspends on thread.queue while its
+    // leaf waits for the net
+    DetachedCoroutine simulate(SearchThread& thread, Node* root, Node* child);
+
+    // descends from child to a leaf, adding virtual loss on the way and
+    // recording the nodes in path. a leaf needing the net is claimed and
+    // expansion filled in. a leaf another thread is expanding is waited for
+    // if wait_for_expansions is set, otherwise it's a collision
+    SelectionResult selectLeaf(SearchThread& thread, Node* child, SearchPath& path, PendingExpansion& expansion, bool wait_for_expansions);
+
+    // evaluates the positions waiting on thread.queue in one call to the net
+    // and resumes their simulations
+    void runBatch(SearchThread& thread);
+
+    // backs the value of path's leaf up through path and removes its
+    // virtual loss. returns the value of the path's first node
+    float backup(const SearchPath& path);
+
+    // widens node's children in line with its visit count
+    void widen(Node* node);
+
+    // picks the child of node to visit next
+    Node* selectChild(Node* node);
+
+    // makes move from thread.path[depth] and stores the result in
+    // thread.path[depth + 1]
+    void pushPath(SearchThread& thread, int depth, const Move& move);
+
+    // piece planes of the positions played before the root, which have no
+    // nodes of their own
+    std::array<PiecePlanes, POS_HISTORY_LEN> root_ancestor_planes;
+    int n_root_ancestors = 0;
     std::random_device rd{};
     std::mt19937 gen{rd()};
     std::extreme_value_distribution<float> gumbel_dist{0.0, 1};
@@ -0,0 +1,44 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// fixed set of worker threads that run batches of tasks. run() only returns
+// once the whole batch is done so each call acts as a barrier
+class ThreadPool {
+  public:
+    ThreadPool(int n_threads);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // calls task(task_index, thread_index) for every task_index in
+    // [0, n_tasks), spreading them over the workers. thread_index is in
+    // [0, size()) and lets tasks use per-thread state without locking
+    void run(int n_tasks, const std::function<void(int, int)>& task);
+
+    int size() const;
+
+  private:
+    void work(int thread_index);
+
+    std::mutex mutex;
+    std::condition_variable work_cv;
+    std::condition_variable done_cv;
+    const std::function<void(int, int)>* cur_task = nullptr;
+    int n_tasks = 0;
+    std::atomic<int> next_task = 0;
+    // workers still working on the current batch
+    int n_busy = 0;
+    // bumped for every batch so workers can tell a new one has started
+    unsigned long long batch = 0;
+    bool stopping = false;
+    std::vector<std::thread> threads;
+};
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,120 @@
+#ifndef UCI_H
+#define UCI_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <istream>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "move_generator.h"
+#include "net.h"
+#include "nn_cache.h"
+#include "position.h"
+#include "search.h"
+
+// how often a running search reports its progress with an info line
+constexpr std::chrono::milliseconds UCI_INFO_INTERVAL{500};
+// kept back from every time budget for talking to the GUI
+constexpr std::chrono::milliseconds UCI_MOVE_OVERHEAD{30};
+// moves the remaining clock is shared out over when the GUI doesn't say
+constexpr int UCI_DEFAULT_MOVES_TO_GO = 30;
+// budget of go infinite, which only ends on stop
+constexpr std::chrono::hours UCI_INFINITE_BUDGET{24 * 365};
+// budget of go without a clock or movetime, e.g. go depth or go nodes,
+// whose limits the search doesn't have
+constexpr std::chrono::milliseconds UCI_DEFAULT_MOVETIME{1000};
+
+// finds the legal move in pos written in UCI notation
+std::optional<Move> parseUCIMove(MoveGenerator& move_gen, const Position& pos, const std::string& uci);
+
+// speaks the UCI protocol. commands are handled on the caller's thread and
+// searches run on a thread of their own so stop and isready are answered
+// straight away. a second thread reports the search's progress so writing
+// info lines never holds up the simulations.
+//
+// with the Ponder option on, go ponder searches the position after the
+// expected reply until ponderhit or stop. ponderhit restarts it as a normal
+// search, which carries on from the pondering search's tree
+class UCIEngine {
+  public:
+    // cache is optional and may be shared with other searchers
+    UCIEngine(Net* net, std::ostream& out, NNCache* cache = nullptr,
+              const SearchOptions& options = SearchOptions());
+    // stops any running search
+    ~UCIEngine();
+    UCIEngine(const UCIEngine&) = delete;
+    UCIEngine& operator=(const UCIEngine&) = delete;
+
+    // handles commands from in until quit or the end of the input
+    void loop(std::istream& in);
+    // handles one command, returns false on quit
+    bool handleCommand(const std::string& line);
+    // blocks until the running search, if any, has sent its bestmove
+    void waitForSearch();
+
+    // the game so far, the current position is game.back()
+    const std::deque<Position>& getGame() const;
+
+  private:
+    void setOption(std::istringstream& args);
+    void setPosition(std::istringstream& args);
+    void go(std::istringstream& args);
+    void ponderHit(SearchClock::time_point received);
+    // works out how long to search for from go's arguments and whether to
+    // ponder or search until stop
+    std::chrono::milliseconds getTimeBudget(std::istringstream& args, bool& ponder, bool& infinite) const;
+
+    void startSearch(std::chrono::milliseconds time_budget, bool ponder, bool infinite);
+    // stops the running search, if any, and lets it send its bestmove
+    void stopSearch();
+
+    void search(std::chrono::milliseconds time_budget);
+    void reportProgress();
+
+    // writes line to out in one go, as both search threads write too
+    void send(const std::string& line);
+    // reports how long a command took to answer when debug is on
+    void sendLatency(const std::string& command, SearchClock::time_point received);
+
+    GumbelMCTS searcher;
+    MoveGenerator move_gen;
+    NNCache* cache;
+    std::ostream& out;
+    std::mutex out_mutex;
+    // set by debug on, read by the search thread too
+    std::atomic<bool> debug = false;
+    std::atomic<bool> ponder_option = false;
+
+    // positions keep pointers to their parents so a deque keeps them valid
+    std::deque<Position> game;
+
+    std::thread search_thread;
+    std::thread info_thread;
+    std::mutex search_mutex;
+    std::condition_variable search_cv;
+    bool searching = false;
+    // the running search is pondering and, once ponder_hit is set, is being
+    // stopped to restart as a normal search with ponder_hit_budget
+    bool pondering = false;
+    bool ponder_hit = false;
+    // go infinite and go ponder may only send their bestmove after stop,
+    // quit or, when pondering, ponderhit, even when the search ends by
+    // itself, e.g. with a single legal move. it then waits until
+    // release_bestmove is set
+    bool hold_bestmove = false;
+    bool release_bestmove = false;
+    std::chrono::milliseconds ponder_hit_budget{0};
+    bool ponder_hit_infinite = false;
+    SearchClock::time_point search_start;
+    // when stop arrived, so its latency can be reported with the bestmove
+    std::optional<SearchClock::time_point> stop_received;
+};
+
+#endif // UCI_H
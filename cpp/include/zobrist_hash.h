@@ -23,10 +23,15 @@ class ZobristHash {
 
     // returns current hash
     unsigned long long getHash() const;
-
+    // returns the hash the position would have with the board mirrored
+    // vertically and the colours swapped, kept up to date by every update
+    unsigned long long getFlippedHash() const;
+    // returns the hash of the flipped position
+    ZobristHash flipped() const;
 
   private:
     unsigned long long val = 0;
+    unsigned long long flipped_val = 0;
 
     // TODO: it would be better if I could make these const
     // we should only create these once per run
@@ -0,0 +1,52 @@
+#include <algorithm>
+
+#include "arena.h"
+
+Arena::~Arena() {
+  release();
+}
+
+void* Arena::allocate(size_t size, size_t alignment) {
+  while (cur_slab < slabs.size()) {
+    Slab& slab = slabs[cur_slab];
+    size_t aligned_offset = (offset + alignment - 1) & ~(alignment - 1);
+    if (aligned_offset + size <= slab.size) {
+      offset = aligned_offset + size;
+      bytes_used += size;
+      return slab.data.get() + aligned_offset;
+    }
+    // doesn't fit so move on to the next slab, wasting the end of this one
+    cur_slab++;
+    offset = 0;
+  }
+
+  // out of slabs so add one, big enough for size if it's larger than a slab.
+  // new[] aligns to at least alignof(std::max_align_t) and, unlike
+  // make_unique, doesn't zero the slab
+  size_t new_slab_size = std::max(slab_size, size);
+  slabs.push_back(Slab{std::unique_ptr<std::byte[]>(new std::byte[new_slab_size]), new_slab_size});
+  bytes_reserved += new_slab_size;
+  cur_slab = slabs.size() - 1;
+  offset = size;
+  bytes_used += size;
+  return slabs.back().data.get();
+}
+
+void Arena::release() {
+  // destroy in reverse order of construction
+  for (auto it = destructors.rbegin(); it != destructors.rend(); it++) {
+    it->second(it->first);
+  }
+  destructors.clear();
+  cur_slab = 0;
+  offset = 0;
+  bytes_used = 0;
+}
+
+size_t Arena::bytesUsed() const {
+  return bytes_used;
+}
+
+size_t Arena::bytesReserved() const {
+  return bytes_reserved;
+}
@@ -0,0 +1,118 @@
+#include <array>
+#include <cmath>
+
+#include "net.h"
+#include "constants.h"
+#include "utils.h"
+
+// centipawn score that maps to a value of tanh(1) ~ 0.76
+constexpr double DUMMY_VALUE_SCALE = 400.0;
+
+constexpr std::array<int, 6> piece_values = {100, 320, 330, 500, 900, 0};
+
+// piece-square tables from white's perspective indexed by square, so a1 comes
+// first and each row below is a rank. black pieces look up square ^ 0x38
+constexpr std::array<std::array<int, 64>, 6> piece_square_tables = {{
+  // pawn
+  {  0,   0,   0,   0,   0,   0,   0,   0,
+     5,  10,  10, -20, -20,  10,  10,   5,
+     5,  -5, -10,   0,   0, -10,  -5,   5,
+     0,   0,   0,  20,  20,   0,   0,   0,
+     5,   5,  10,  25,  25,  10,   5,   5,
+    10,  10,  20,  30,  30,  20,  10,  10,
+    50,  50,  50,  50,  50,  50,  50,  50,
+     0,   0,   0,   0,   0,   0,   0,   0},
+  // knight
+  {-50, -40, -30, -30, -30, -30, -40, -50,
+   -40, -20,   0,   5,   5,   0, -20, -40,
+   -30,   5,  10,  15,  15,  10,   5, -30,
+   -30,   0,  15,  20,  20,  15,   0, -30,
+   -30,   5,  15,  20,  20,  15,   5, -30,
+   -30,   0,  10,  15,  15,  10,   0, -30,
+   -40, -20,   0,   0,   0,   0, -20, -40,
+   -50, -40, -30, -30, -30, -30, -40, -50},
+  // bishop
+  {-20, -10, -10, -10, -10, -10, -10, -20,
+   -10,   5,   0,   0,   0,   0,   5, -10,
+   -10,  10,  10,  10,  10,  10,  10, -10,
+   -10,   0,  10,  10,  10,  10,   0, -10,
+   -10,   5,   5,  10,  10,   5,   5, -10,
+   -10,   0,   5,  10,  10,   5,   0, -10,
+   -10,   0,   0,   0,   0,   0,   0, -10,
+   -20, -10, -10, -10, -10, -10, -10, -20},
+  // rook
+  {  0,   0,   0,   5,   5,   0,   0,   0,
+    -5,   0,   0,   0,   0,   0,   0,  -5,
+    -5,   0,   0,   0,   0,   0,   0,  -5,
+    -5,   0,   0,   0,   0,   0,   0,  -5,
+    -5,   0,   0,   0,   0,   0,   0,  -5,
+    -5,   0,   0,   0,   0,   0,   0,  -5,
+     5,  10,  10,  10,  10,  10,  10,   5,
+     0,   0,   0,   0,   0,   0,   0,   0},
+  // queen
+  {-20, -10, -10,  -5,  -5, -10, -10, -20,
+   -10,   0,   5,   0,   0,   0,   0, -10,
+   -10,   5,   5,   5,   5,   5,   0, -10,
+     0,   0,   5,   5,   5,   5,   0,  -5,
+    -5,   0,   5,   5,   5,   5,   0,  -5,
+   -10,   0,   5,   5,   5,   5,   0, -10,
+   -10,   0,   0,   0,   0,   0,   0, -10,
+   -20, -10, -10,  -5,  -5, -10, -10, -20},
+  // king
+  { 20,  30,  10,   0,   0,  10,  30,  20,
+    20,  20,   0,   0,   0,   0,  20,  20,
+   -10, -20, -20, -20, -20, -20, -20, -10,
+   -20, -30, -30, -40, -40, -30, -30, -20,
+   -30, -40, -40, -50, -50, -40, -40, -30,
+   -30, -40, -40, -50, -50, -40, -40, -30,
+   -30, -40, -40, -50, -50, -40, -40, -30,
+   -30, -40, -40, -50, -50, -40, -40, -30},
+}};
+
+int DummyNet::evaluateMaterial(const Position& pos) {
+  int score = 0;
+  for (int piece = PieceType::Pawn; piece <= PieceType::King; piece++) {
+    BitBoard white_bb = pos.getPieceBitBoard(Colour::White, static_cast<PieceType>(piece));
+    while (!white_bb.isEmpty()) {
+      int square = white_bb.popHighestSetBit();
+      score += piece_values[piece] + piece_square_tables[piece][square];
+    }
+    BitBoard black_bb = pos.getPieceBitBoard(Colour::Black, static_cast<PieceType>(piece));
+    while (!black_bb.isEmpty()) {
+      int square = black_bb.popHighestSetBit();
+      score -= piece_values[piece] + piece_square_tables[piece][square ^ 0x38];
+    }
+  }
+  return score;
+}
+
+double DummyNet::getEvaluation(const Position& pos, const BoardBits* /*packed_planes*/, std::vector<std::pair<Move, float>>& policy) {
+  MoveVec legal_moves = move_gen.generateMoves(pos);
+  float total_weight = 0;
+  for (const Move& move : legal_moves) {
+    float weight = 1;
+    if (priors == DummyPriors::CaptureBiased) {
+      // favour winning more material, a pawn capture is twice as likely as a
+      // quiet move and a queen capture ten times
+      if (move.move_type == MoveType::Capture) {
+        weight += piece_values[pos.getPieceType(invertColour(pos.getSideToMove()), move.dest)] / 100.0f;
+      } else if (move.move_type == MoveType::EnPassantCapture) {
+        weight += piece_values[PieceType::Pawn] / 100.0f;
+      }
+      if (move.promotion != PieceType::None) {
+        weight += piece_values[move.promotion] / 100.0f;
+      }
+    }
+    policy.emplace_back(move, weight);
+    total_weight += weight;
+  }
+  for (auto& move_prior : policy) {
+    move_prior.second /= total_weight;
+  }
+
+  int score = evaluateMaterial(pos);
+  if (pos.getSideToMove() == Colour::Black) {
+    score = -score;
+  }
+  return std::tanh(score / DUMMY_VALUE_SCALE);
+}
@@ -0,0 +1,145 @@
+#include <algorithm>
+#include <cstdlib>
+
+#include "encoding.h"
+#include "constants.h"
+#include "utils.h"
+
+PiecePlanes encodePiecePlanes(const Position& pos) {
+  PiecePlanes planes;
+  for (int piece = PieceType::Pawn; piece <= PieceType::King; piece++) {
+    BitBoard white_bb = pos.getPieceBitBoard(Colour::White, static_cast<PieceType>(piece));
+    BitBoard black_bb = pos.getPieceBitBoard(Colour::Black, static_cast<PieceType>(piece));
+    planes.by_perspective[Colour::White][piece] = white_bb.board;
+    planes.by_perspective[Colour::White][piece + 6] = black_bb.board;
+    // if black is to move the input is flipped, same as Position::flip(), so
+    // black's pieces come first like white's do when white is to move
+    planes.by_perspective[Colour::Black][piece] = black_bb.flip().board;
+    planes.by_perspective[Colour::Black][piece + 6] = white_bb.flip().board;
+  }
+  return planes;
+}
+
+void castlingRightsToPlanes(const Position& pos, BoardBits* packed_planes) {
+  // flipping the board for black swaps whose castling rights come first
+  Colour first = (pos.getSideToMove() == Colour::Black) ? Colour::Black : Colour::White;
+  Colour second = invertColour(first);
+  packed_planes[0] = pos.canCastle(first, CastlingType::Kingside) ? ALL_SQUARES : 0;
+  packed_planes[1] = pos.canCastle(first, CastlingType::Queenside) ? ALL_SQUARES : 0;
+  packed_planes[2] = pos.canCastle(second, CastlingType::Kingside) ? ALL_SQUARES : 0;
+  packed_planes[3] = pos.canCastle(second, CastlingType::Queenside) ? ALL_SQUARES : 0;
+}
+
+void encodePackedInput(const Position& pos, const InputHistory& history, BoardBits* packed_planes) {
+  // add current board position then the previous positions from the side to
+  // move's perspective, leaving the planes empty if there is no history
+  BoardBits* cur_plane = packed_planes;
+  for (const PiecePlanes* planes : history) {
+    if (planes != nullptr) {
+      const auto& perspective_planes = planes->by_perspective[pos.getSideToMove()];
+      std::copy(perspective_planes.begin(), perspective_planes.end(), cur_plane);
+    } else {
+      std::fill_n(cur_plane, N_PIECE_PLANES, 0);
+    }
+    cur_plane += N_PIECE_PLANES;
+  }
+
+  castlingRightsToPlanes(pos, cur_plane);
+  cur_plane += 4;
+
+  // if it's white to move add a plane of 1s, if black add a plane of zeros
+  // this is how neural net will "know" which colour is actually to move because we
+  // transform the board repr so it's always white to move
+  *cur_plane = (pos.getSideToMove() == Colour::White) ? ALL_SQUARES : 0;
+  cur_plane++;
+
+  // help BlunderNet find edge of board with a plane of just 1s
+  *cur_plane = ALL_SQUARES;
+}
+
+void encodePackedInput(const Position& pos, BoardBits* packed_planes) {
+  std::array<PiecePlanes, POS_HISTORY_LEN + 1> planes;
+  InputHistory history{};
+  const Position* cur_pos = &pos;
+  for (int i = 0; i <= POS_HISTORY_LEN && cur_pos != nullptr; i++) {
+    planes[i] = encodePiecePlanes(*cur_pos);
+    history[i] = &planes[i];
+    cur_pos = cur_pos->getParent();
+  }
+  encodePackedInput(pos, history, packed_planes);
+}
+
+void unpackPlanes(const BoardBits* packed_planes, float* planes) {
+  for (int plane = 0; plane < N_INPUT_PLANES; plane++) {
+    BoardBits bits = packed_planes[plane];
+    float* out = planes + (plane * N_SQUARES);
+    for (int square = 0; square < N_SQUARES; square++) {
+      out[square] = static_cast<float>((bits >> square) & 1);
+    }
+  }
+}
+
+void encodeInputPlanes(const Position& pos, float* planes) {
+  BoardBits packed_planes[N_INPUT_PLANES];
+  encodePackedInput(pos, packed_planes);
+  unpackPlanes(packed_planes, planes);
+}
+
+// NOTE: not happy with this - return to it
+Move policyIndexToMove(int index, const Position& pos) {
+  Move move;
+  // normal moves
+  if (index < 64 * 64) {
+    int king_index = pos.getPieceBitBoard(pos.getSideToMove(), PieceType::King).getHighestSetBit();
+    int source = index / 64;
+    int dest = index % 64;
+    // if black is to move we will have flipped the input so we must flip the
+    // output
+    if (pos.getSideToMove() == Colour::Black) {
+      source = source ^ 0x38;
+      dest = dest ^ 0x38;
+    }
+    // try to detect castling
+    // NOTE: not very confident in this
+    if (source == king_index && abs(source - dest) > 2) {
+      if ((source == 4 && dest == 6) || (source == 60 && dest == 62)) {
+        move = Move(source, dest, MoveType::KingsideCastle);
+      } else if ((source == 4 && dest == 2) || (source == 60 && dest == 58)) {
+        move = Move(source, dest, MoveType::QueensideCastle);
+      }
+    // TODO: this will not detect enpassant!!!
+    } else if (pos.isOccupied(dest)) {
+      move = Move(source, dest, MoveType::Capture);
+    } else {
+      move = Move(source, dest, MoveType::Quiet);
+    }
+
+  } else {
+    // promotions
+    int side = index / (8 * 8 * 4);
+    int rebased_source = (index - side) / (8 * 4);
+    int rebased_dest = (index - side - rebased_source) / 4;
+    int piece = index - rebased_source  - rebased_dest;
+    int source;
+    int dest;
+    if (side == 0) {
+      source = rebased_source + 48;
+      dest = rebased_dest + 57;
+    } else { // TODO: we should never see this because of the pos flip so probably remove
+      source = rebased_source - 8;
+      dest = rebased_dest;
+    }
+
+    if (pos.getSideToMove() == Colour::Black) {
+      source = source ^ 0x38;
+      dest = dest ^ 0x38;
+    }
+
+    if (pos.isOccupied(dest)) {
+      move = Move(source, dest, MoveType::Capture, static_cast<PieceType>(piece + 1));
+    } else {
+      move = Move(source, dest, MoveType::Quiet, static_cast<PieceType>(piece + 1));
+    }
+  }
+  return move;
+}
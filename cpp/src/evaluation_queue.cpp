@@ -0,0 +1,57 @@
+#include "evaluation_queue.h"
+
+void EvaluationQueue::EvaluationAwaiter::await_suspend(std::coroutine_handle<> handle) {
+  index = queue.waiting.size();
+  BatchEntry& entry = queue.waiting.emplace_back();
+  entry.pos = &pos;
+  entry.packed_planes = packed_planes;
+  queue.waiting_handles.push_back(handle);
+}
+
+BatchEntry& EvaluationQueue::EvaluationAwaiter::await_resume() {
+  // runBatch has moved the entry over to evaluated by now
+  return queue.evaluated[index];
+}
+
+void EvaluationQueue::RetryAwaiter::await_suspend(std::coroutine_handle<> handle) {
+  queue.retrying.push_back(handle);
+}
+
+EvaluationQueue::EvaluationAwaiter EvaluationQueue::evaluate(const Position& pos, const BoardBits* packed_planes) {
+  return EvaluationAwaiter{*this, pos, packed_planes};
+}
+
+EvaluationQueue::RetryAwaiter EvaluationQueue::nextBatch() {
+  return RetryAwaiter{*this};
+}
+
+int EvaluationQueue::size() const {
+  return waiting.size();
+}
+
+int EvaluationQueue::inFlight() const {
+  return waiting.size() + retrying.size();
+}
+
+bool EvaluationQueue::empty() const {
+  return waiting.empty() && retrying.empty();
+}
+
+void EvaluationQueue::runBatch(const std::function<void(std::span<BatchEntry>)>& evaluate_batch) {
+  evaluated.clear();
+  evaluated_handles.clear();
+  resuming.clear();
+  std::swap(waiting, evaluated);
+  std::swap(waiting_handles, evaluated_handles);
+  std::swap(retrying, resuming);
+
+  if (!evaluated.empty()) {
+    evaluate_batch(evaluated);
+  }
+  for (std::coroutine_handle<> handle : evaluated_handles) {
+    handle.resume();
+  }
+  for (std::coroutine_handle<> handle : resuming) {
+    handle.resume();
+  }
+}
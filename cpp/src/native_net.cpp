@@ -0,0 +1,323 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "native_net.h"
+
+constexpr char NATIVE_WEIGHTS_MAGIC[4] = {'B', 'L', 'N', 'W'};
+constexpr int32_t NATIVE_WEIGHTS_VERSION = 1;
+
+// the kernels below work on tiles of GEMM_ROWS output channels by
+// GEMM_VECS vectors of pixels, sized so the accumulators fit in registers
+#if defined(__AVX512F__)
+using Vec = __m512;
+constexpr int VEC_WIDTH = 16;
+constexpr int GEMM_ROWS = 4;
+constexpr int GEMM_VECS = 4;
+inline Vec vecZero() { return _mm512_setzero_ps(); }
+inline Vec vecLoad(const float* p) { return _mm512_loadu_ps(p); }
+inline void vecStore(float* p, Vec v) { _mm512_storeu_ps(p, v); }
+inline Vec vecBroadcast(float f) { return _mm512_set1_ps(f); }
+inline Vec vecFma(Vec a, Vec b, Vec c) { return _mm512_fmadd_ps(a, b, c); }
+inline float vecSum(Vec v) { return _mm512_reduce_add_ps(v); }
+#define BLUNDER_SIMD_KERNELS
+#elif defined(__AVX2__) && defined(__FMA__)
+using Vec = __m256;
+constexpr int VEC_WIDTH = 8;
+constexpr int GEMM_ROWS = 3;
+constexpr int GEMM_VECS = 4;
+inline Vec vecZero() { return _mm256_setzero_ps(); }
+inline Vec vecLoad(const float* p) { return _mm256_loadu_ps(p); }
+inline void vecStore(float* p, Vec v) { _mm256_storeu_ps(p, v); }
+inline Vec vecBroadcast(float f) { return _mm256_set1_ps(f); }
+inline Vec vecFma(Vec a, Vec b, Vec c) { return _mm256_fmadd_ps(a, b, c); }
+inline float vecSum(Vec v) {
+  __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+  sum = _mm_add_ss(sum, _mm_movehdup_ps(sum));
+  return _mm_cvtss_f32(sum);
+}
+#define BLUNDER_SIMD_KERNELS
+#endif
+
+#ifdef BLUNDER_SIMD_KERNELS
+// computes ROWS rows of output, GEMM_VECS * VEC_WIDTH pixels starting at
+// pixel_offset. weights is [ROWS][k], col is [k][N_SQUARES]
+template <int ROWS>
+inline void gemmTile(const float* weights, int k, const float* col, int pixel_offset, float* output) {
+  // the unroll pragmas keep the accumulators in registers even at -O2
+  Vec acc[ROWS][GEMM_VECS];
+#pragma GCC unroll 16
+  for (int r = 0; r < ROWS; r++) {
+#pragma GCC unroll 16
+    for (int v = 0; v < GEMM_VECS; v++) {
+      acc[r][v] = vecZero();
+    }
+  }
+
+  for (int i = 0; i < k; i++) {
+    const float* col_row = col + (i * N_SQUARES) + pixel_offset;
+    Vec pixels[GEMM_VECS];
+#pragma GCC unroll 16
+    for (int v = 0; v < GEMM_VECS; v++) {
+      pixels[v] = vecLoad(col_row + (v * VEC_WIDTH));
+    }
+#pragma GCC unroll 16
+    for (int r = 0; r < ROWS; r++) {
+      Vec w = vecBroadcast(weights[(r * k) + i]);
+#pragma GCC unroll 16
+      for (int v = 0; v < GEMM_VECS; v++) {
+        acc[r][v] = vecFma(w, pixels[v], acc[r][v]);
+      }
+    }
+  }
+
+#pragma GCC unroll 16
+  for (int r = 0; r < ROWS; r++) {
+#pragma GCC unroll 16
+    for (int v = 0; v < GEMM_VECS; v++) {
+      vecStore(output + (r * N_SQUARES) + pixel_offset + (v * VEC_WIDTH), acc[r][v]);
+    }
+  }
+}
+#endif
+
+// output[m][N_SQUARES] = weights[m][k] * col[k][N_SQUARES]
+void gemm(const float* weights, int m, int k, const float* col, float* output, bool simd) {
+#ifdef BLUNDER_SIMD_KERNELS
+  if (simd) {
+    for (int pixel_offset = 0; pixel_offset < N_SQUARES; pixel_offset += GEMM_VECS * VEC_WIDTH) {
+      int row = 0;
+      for (; row + GEMM_ROWS <= m; row += GEMM_ROWS) {
+        gemmTile<GEMM_ROWS>(weights + (row * k), k, col, pixel_offset, output + (row * N_SQUARES));
+      }
+      for (; row < m; row++) {
+        gemmTile<1>(weights + (row * k), k, col, pixel_offset, output + (row * N_SQUARES));
+      }
+    }
+    return;
+  }
+#endif
+  std::fill_n(output, m * N_SQUARES, 0.0f);
+  for (int row = 0; row < m; row++) {
+    float* out_row = output + (row * N_SQUARES);
+    for (int i = 0; i < k; i++) {
+      float w = weights[(row * k) + i];
+      const float* col_row = col + (i * N_SQUARES);
+      for (int p = 0; p < N_SQUARES; p++) {
+        out_row[p] += w * col_row[p];
+      }
+    }
+  }
+}
+
+float dot(const float* a, const float* b, int n, bool simd) {
+  int i = 0;
+  float sum = 0;
+#ifdef BLUNDER_SIMD_KERNELS
+  if (simd) {
+    Vec acc = vecZero();
+    for (; i + VEC_WIDTH <= n; i += VEC_WIDTH) {
+      acc = vecFma(vecLoad(a + i), vecLoad(b + i), acc);
+    }
+    sum = vecSum(acc);
+  }
+#endif
+  for (; i < n; i++) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+// y = weights * x + bias for a fully connected layer
+void matVec(const NativeLayer& layer, const float* x, float* y, bool relu, bool simd) {
+  for (int row = 0; row < layer.out_size; row++) {
+    float val = dot(layer.weights.data() + (row * layer.in_size), x, layer.in_size, simd) + layer.bias[row];
+    y[row] = relu ? std::max(val, 0.0f) : val;
+  }
+}
+
+// adds bias then applies relu and/or a residual connection in place
+void applyEpilogue(float* output, const NativeLayer& layer, bool relu, const float* residual) {
+  for (int row = 0; row < layer.out_size; row++) {
+    float bias = layer.bias[row];
+    float* out_row = output + (row * N_SQUARES);
+    const float* res_row = residual ? residual + (row * N_SQUARES) : nullptr;
+    for (int p = 0; p < N_SQUARES; p++) {
+      float val = out_row[p] + bias;
+      if (relu) {
+        val = std::max(val, 0.0f);
+      }
+      if (res_row != nullptr) {
+        val += res_row[p];
+      }
+      out_row[p] = val;
+    }
+  }
+}
+
+// lays out each 3x3 neighbourhood of input so the convolution becomes a GEMM.
+// col is [channels * 9][N_SQUARES] with zeros where the kernel hangs off the
+// edge of the board
+void im2col3x3(const float* input, int channels, float* col) {
+  for (int c = 0; c < channels; c++) {
+    const float* plane = input + (c * N_SQUARES);
+    for (int ky = 0; ky < 3; ky++) {
+      for (int kx = 0; kx < 3; kx++) {
+        float* col_row = col + (((c * 9) + (ky * 3) + kx) * N_SQUARES);
+        for (int rank = 0; rank < 8; rank++) {
+          float* dst = col_row + (rank * 8);
+          int src_rank = rank + ky - 1;
+          if (src_rank < 0 || src_rank > 7) {
+            std::fill_n(dst, 8, 0.0f);
+            continue;
+          }
+          // shift the whole rank by one file, padding with a zero
+          const float* src = plane + (src_rank * 8);
+          if (kx == 0) {
+            dst[0] = 0;
+            std::copy_n(src, 7, dst + 1);
+          } else if (kx == 1) {
+            std::copy_n(src, 8, dst);
+          } else {
+            std::copy_n(src + 1, 7, dst);
+            dst[7] = 0;
+          }
+        }
+      }
+    }
+  }
+}
+
+NativeLayer readLayer(std::ifstream& file) {
+  NativeLayer layer;
+  int32_t sizes[2];
+  file.read(reinterpret_cast<char*>(sizes), sizeof(sizes));
+  if (!file || sizes[0] <= 0 || sizes[1] <= 0) {
+    throw std::runtime_error("corrupt layer header in native weights file");
+  }
+  layer.out_size = sizes[0];
+  layer.in_size = sizes[1];
+  layer.weights.resize(layer.out_size * layer.in_size);
+  layer.bias.resize(layer.out_size);
+  file.read(reinterpret_cast<char*>(layer.weights.data()), layer.weights.size() * sizeof(float));
+  file.read(reinterpret_cast<char*>(layer.bias.data()), layer.bias.size() * sizeof(float));
+  if (!file) {
+    throw std::runtime_error("truncated native weights file");
+  }
+  return layer;
+}
+
+NativeBlunderNet::NativeBlunderNet(const std::string& weights_path, bool simd_kernels)
+    : simd_kernels(simd_kernels && hasSIMDKernels()) {
+  std::ifstream file(weights_path, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error("could not open native weights file " + weights_path);
+  }
+
+  char magic[4];
+  int32_t header[2];
+  file.read(magic, sizeof(magic));
+  file.read(reinterpret_cast<char*>(header), sizeof(header));
+  if (!file || std::memcmp(magic, NATIVE_WEIGHTS_MAGIC, sizeof(magic)) != 0 ||
+      header[0] != NATIVE_WEIGHTS_VERSION) {
+    throw std::runtime_error(weights_path + " is not a version " +
+                             std::to_string(NATIVE_WEIGHTS_VERSION) + " native weights file");
+  }
+  int n_res_blocks = header[1];
+
+  input_conv = readLayer(file);
+  for (int i = 0; i < n_res_blocks; i++) {
+    res_convs.push_back(readLayer(file));
+  }
+  policy_conv = readLayer(file);
+  policy_fc = readLayer(file);
+  value_conv = readLayer(file);
+  value_fc1 = readLayer(file);
+  value_fc2 = readLayer(file);
+
+  int channels = input_conv.out_size;
+  if (input_conv.in_size != N_INPUT_PLANES * 9 || policy_fc.out_size != N_POLICY_OUTPUTS ||
+      policy_fc.in_size != policy_conv.out_size * N_SQUARES ||
+      value_fc1.in_size != value_conv.out_size * N_SQUARES || value_fc2.out_size != 1) {
+    throw std::runtime_error("native weights file does not match BlunderNet's input/output shapes");
+  }
+
+  input.resize(N_INPUT_PLANES * N_SQUARES);
+  im2col.resize(std::max(N_INPUT_PLANES, channels) * 9 * N_SQUARES);
+  trunk_a.resize(channels * N_SQUARES);
+  trunk_b.resize(channels * N_SQUARES);
+  policy_hidden.resize(policy_conv.out_size * N_SQUARES);
+  value_hidden.resize(value_conv.out_size * N_SQUARES);
+  value_fc1_out.resize(value_fc1.out_size);
+  policy_logits.resize(N_POLICY_OUTPUTS);
+}
+
+bool NativeBlunderNet::hasSIMDKernels() {
+#ifdef BLUNDER_SIMD_KERNELS
+  return true;
+#else
+  return false;
+#endif
+}
+
+void NativeBlunderNet::conv3x3(const NativeLayer& layer, const float* input, float* output, bool relu, const float* residual) {
+  im2col3x3(input, layer.in_size / 9, im2col.data());
+  gemm(layer.weights.data(), layer.out_size, layer.in_size, im2col.data(), output, simd_kernels);
+  applyEpilogue(output, layer, relu, residual);
+}
+
+void NativeBlunderNet::conv1x1(const NativeLayer& layer, const float* input, float* output) {
+  // a 1x1 convolution is already a GEMM over the input planes
+  gemm(layer.weights.data(), layer.out_size, layer.in_size, input, output, simd_kernels);
+  applyEpilogue(output, layer, true, nullptr);
+}
+
+float NativeBlunderNet::forward(const float* input_planes, float* policy_out) {
+  conv3x3(input_conv, input_planes, trunk_a.data(), true);
+  float* cur = trunk_a.data();
+  float* next = trunk_b.data();
+  for (const NativeLayer& res_conv : res_convs) {
+    conv3x3(res_conv, cur, next, true, cur);
+    std::swap(cur, next);
+  }
+
+  conv1x1(policy_conv, cur, policy_hidden.data());
+  matVec(policy_fc, policy_hidden.data(), policy_out, false, simd_kernels);
+
+  conv1x1(value_conv, cur, value_hidden.data());
+  matVec(value_fc1, value_hidden.data(), value_fc1_out.data(), true, simd_kernels);
+  float value;
+  matVec(value_fc2, value_fc1_out.data(), &value, false, simd_kernels);
+  return std::tanh(value);
+}
+
+double NativeBlunderNet::getEvaluation(const Position& pos, const BoardBits* packed_planes, std::vector<std::pair<Move, float>>& policy) {
+  unpackPlanes(packed_planes, input.data());
+  double value = forward(input.data(), policy_logits.data());
+
+  // softmax over the policy logits
+  float max_logit = *std::max_element(policy_logits.begin(), policy_logits.end());
+  float total = 0;
+  for (float& logit : policy_logits) {
+    logit = std::exp(logit - max_logit);
+    total += logit;
+  }
+  policy.reserve(policy.size() + N_POLICY_OUTPUTS);
+  for (int i = 0; i < N_POLICY_OUTPUTS; i++) {
+    policy.push_back(std::make_pair(policyIndexToMove(i, pos), policy_logits[i] / total));
+  }
+
+  // if we flipped board then we must also flip evaluation
+  if (pos.getSideToMove() == Colour::Black) {
+    value = value * -1;
+  }
+  return value;
+}
@@ -1,15 +1,25 @@
+#include <cstring>
+#include <mutex>
+
+#include <ATen/Context.h>
+#include <ATen/Parallel.h>
 #include <ATen/ops/ones.h>
+#include <c10/core/InferenceMode.h>
 #include <torch/nn/options/activation.h>
 #include <torch/torch.h>
 #include <torch/nn/functional.h>
 
 #include "net.h"
+#include "encoding.h"
 #include "constants.h"
 #include "utils.h"
 #include "squares.h"
 
 #include "stdio.h"
 
+// the profiling executor specialises the graph after its first couple of runs
+constexpr int N_WARMUP_PASSES = 2;
+
 void printTensorShape(torch::Tensor& tensor) {
   printf("tensor shape: (");
   for (auto& size : tensor.sizes()) {
@@ -18,183 +28,79 @@ void printTensorShape(torch::Tensor& tensor) {
   printf(")\n");
 }
 
-// NOTE: should this perhaps be methods on bitboard and position?
-torch::Tensor bitboardToTensor(BitBoard bb) {
-  torch::Tensor board_tensor = torch::zeros({1, 8, 8});
-  // set every board position where there is a piece
-  while (!bb.isEmpty()) {
-    int square_index = bb.popHighestSetBit();
-    board_tensor[0][square_index / 8][square_index % 8] = 1;
+torch::Tensor BlunderNet::inputToTensor(const BoardBits* const* packed_planes, int n) {
+  if (options.packed_input) {
+    // the model unpacks the bits itself so we only hand over 1 word per plane
+    static_assert(sizeof(BoardBits) == sizeof(int64_t));
+    torch::Tensor tensor = torch::empty({n, N_INPUT_PLANES}, torch::kInt64);
+    for (int i = 0; i < n; i++) {
+      std::memcpy(tensor.data_ptr<int64_t>() + i * N_INPUT_PLANES, packed_planes[i], N_INPUT_PLANES * sizeof(BoardBits));
+    }
+    return tensor;
   }
 
-  return board_tensor;
+  torch::Tensor tensor = torch::empty({n, N_INPUT_PLANES, 8, 8});
+  for (int i = 0; i < n; i++) {
+    unpackPlanes(packed_planes[i], tensor.data_ptr<float>() + i * N_INPUT_PLANES * N_SQUARES);
+  }
+  if (options.channels_last) {
+    tensor = tensor.contiguous(at::MemoryFormat::ChannelsLast);
+  }
+  return tensor;
 }
 
-// TODO: I suspect this is horribly innefficient - return to this!
-torch::Tensor positionToTensor(const Position& pos, Colour side_to_move) {
-  Position transformed_pos;
-  // we have to flip input if black is to move
-  if (side_to_move == Colour::Black) {
-    transformed_pos = pos.flip();
-  } else {
-    transformed_pos = pos;
+void policyTensorToMoves(torch::Tensor& policy_tensor, std::vector<std::pair<Move, float>>& policy, const Position& pos) {
+  policy_tensor = policy_tensor.contiguous();
+  const float* scores = policy_tensor.data_ptr<float>();
+  for (int i = 0; i < N_POLICY_OUTPUTS; i++) {
+    policy.push_back(std::make_pair(policyIndexToMove(i, pos), scores[i]));
   }
-  std::vector<torch::Tensor> to_move_tensors;
-  std::vector<torch::Tensor> opponent_tensors;
-
-  // get tensors for each piece type per player
-  for (int piece = PieceType::Pawn; piece <= PieceType::King; piece++) {
-    BitBoard to_move_bb = transformed_pos.getPieceBitBoard(Colour::White, static_cast<PieceType>(piece));
-    to_move_tensors.push_back(bitboardToTensor(to_move_bb));
-
-    BitBoard opponent_bb = transformed_pos.getPieceBitBoard(Colour::Black, static_cast<PieceType>(piece));
-    opponent_tensors.push_back(bitboardToTensor(opponent_bb));
-  }  
-  // concatenate all the tensors
-  torch::Tensor to_move_tensor = torch::cat(to_move_tensors, 0);
-  torch::Tensor opponent_tensor = torch::cat(opponent_tensors, 0);
-  return torch::cat({to_move_tensor, opponent_tensor}, 0);
 }
 
-torch::Tensor castlingRightsToTensor(const Position& pos) {
-  Position transformed_pos;
-  // we have to flip input if black is to move
-  if (pos.getSideToMove() == Colour::Black) {
-    transformed_pos = pos.flip();
-  } else {
-    transformed_pos = pos;
+BlunderNet::BlunderNet(const std::string& model_path, const BlunderNetOptions& options) : options(options) {
+  if (options.intra_op_threads > 0) {
+    at::set_num_threads(options.intra_op_threads);
   }
-  torch::Tensor castling_tensor;
-  if (transformed_pos.canCastle(Colour::White, CastlingType::Kingside)) {
-    castling_tensor = torch::ones({1, 8, 8});
-  } else {
-    castling_tensor = torch::zeros({1, 8, 8});
+  if (options.inter_op_threads > 0) {
+    // libtorch throws if the inter-op pool is sized more than once per process
+    static std::once_flag inter_op_flag;
+    std::call_once(inter_op_flag, [&options]() {
+      at::set_num_interop_threads(options.inter_op_threads);
+    });
   }
 
-  if (transformed_pos.canCastle(Colour::White, CastlingType::Queenside)) {
-    castling_tensor = torch::cat({castling_tensor, torch::ones({1, 8, 8})}, 0);
-  } else {
-    castling_tensor = torch::cat({castling_tensor, torch::zeros({1, 8, 8})}, 0);
+  if (options.quantized) {
+    // the int8 model's packed weights only run on the engine they were
+    // quantized for, which is fbgemm on x86
+    at::globalContext().setQEngine(at::QEngine::FBGEMM);
   }
-
-  if (transformed_pos.canCastle(Colour::Black, CastlingType::Kingside)) {
-    castling_tensor = torch::cat({castling_tensor, torch::ones({1, 8, 8})}, 0);
-  } else {
-    castling_tensor = torch::cat({castling_tensor, torch::zeros({1, 8, 8})}, 0);
-  }
-
-  if (transformed_pos.canCastle(Colour::Black, CastlingType::Queenside)) {
-    castling_tensor = torch::cat({castling_tensor, torch::ones({1, 8, 8})}, 0);
-  } else {
-    castling_tensor = torch::cat({castling_tensor, torch::zeros({1, 8, 8})}, 0);
-  }
-
-  return castling_tensor;
-}
-
-torch::Tensor inputToTensor(const Position& pos) {
-  // add current board position
-  torch::Tensor tensor = positionToTensor(pos, pos.getSideToMove());
-  const Position* parent = pos.getParent();
-  // add 5 previous positions
-  for (int i = 0; i < POS_HISTORY_LEN; i++) {
-    if (parent != nullptr) {
-      tensor = torch::cat({tensor, positionToTensor(*parent, pos.getSideToMove())}, 0);
-      parent = parent->getParent();
+  net = torch::jit::load(model_path);
+  // freezing requires eval mode and bakes the eval-mode batch norms in
+  net.eval();
+  if (options.optimise) {
+    if (options.quantized) {
+      // the quantized model already has its batch norms fused and oneDNN
+      // doesn't run quantized ops, so freezing is all we can do
+      net = torch::jit::freeze(net);
     } else {
-      tensor = torch::cat({tensor, torch::zeros({12, 8, 8})}, 0);
+      net = torch::jit::optimize_for_inference(net);
     }
   }
 
-  tensor = torch::cat({tensor, castlingRightsToTensor(pos)},0);
-
-  // if it's white to move add a plane of 1s, if black add a plane of zeros
-  // this is how neural net will "know" which colour is actually to move because we
-  // transform the board repr so it's always white to move
-  if (pos.getSideToMove() == Colour::White) {
-    tensor = torch::cat({tensor, torch::ones({1, 8, 8})}, 0);
-  } else {
-    tensor = torch::cat({tensor, torch::zeros({1, 8, 8})}, 0);
-  }
-
-  // help BlunderNet find edge of board with a plane of just 1s
-  tensor = torch::cat({tensor, torch::ones({1, 8, 8})}, 0);
-  tensor = tensor.unsqueeze(0);
-
-  return tensor;
-}
-
-// NOTE: not happy with this - return to it
-void policyTensorToMoves(torch::Tensor& policy_tensor, std::vector<std::pair<Move, float>>& policy, const Position& pos) {
-  int king_index = pos.getPieceBitBoard(pos.getSideToMove(), PieceType::King).getHighestSetBit();
-  // normal moves + promotion moves
-  for (int i = 0; i < ((64 * 64) + (2 * 8 * 8 * 4)); i++) {
-    // extract move logit
-    float score = policy_tensor[0][i].item().toFloat();
-    Move move;
-    // normal moves
-    if (i < 64 * 64) {
-      int source = i / 64;
-      int dest = i % 64;
-      // if black is to move we will have flipped the input so we must flip the
-      // output
-      if (pos.getSideToMove() == Colour::Black) {
-        source = source ^ 0x38;
-        dest = dest ^ 0x38;
-      }
-      // try to detect castling
-      // NOTE: not very confident in this
-      if (source == king_index && abs(source - dest) > 2) {
-        if ((source == 4 && dest == 6) || (source == 60 && dest == 62)) {
-          move = Move(source, dest, MoveType::KingsideCastle);
-        } else if ((source == 4 && dest == 2) || (source == 60 && dest == 58)) {
-          move = Move(source, dest, MoveType::QueensideCastle);
-        }
-      // TODO: this will not detect enpassant!!!
-      } else if (pos.isOccupied(dest)) {
-        move = Move(source, dest, MoveType::Capture);
-      } else {
-        move = Move(source, dest, MoveType::Quiet);
-      }
-
-    } else {
-      // promotions
-      int side = i / (8 * 8 * 4);
-      int rebased_source = (i - side) / (8 * 4);
-      int rebased_dest = (i - side - rebased_source) / 4;
-      int piece = i - rebased_source  - rebased_dest;
-      int source; 
-      int dest;
-      if (side == 0) {
-        source = rebased_source + 48; 
-        dest = rebased_dest + 57;
-      } else { // TODO: we should never see this because of the pos flip so probably remove
-        source = rebased_source - 8; 
-        dest = rebased_dest;
-      }
-
-      if (pos.getSideToMove() == Colour::Black) {
-        source = source ^ 0x38;
-        dest = dest ^ 0x38;
-      }
-
-      if (pos.isOccupied(dest)) {
-        move = Move(source, dest, MoveType::Capture, static_cast<PieceType>(piece + 1));
-      } else {
-        move = Move(source, dest, MoveType::Quiet, static_cast<PieceType>(piece + 1));
-      }
-
+  if (options.warmup) {
+    Position pos;
+    std::vector<std::pair<Move, float>> policy;
+    for (int i = 0; i < N_WARMUP_PASSES; i++) {
+      policy.clear();
+      getEvaluation(pos, policy);
     }
-    policy.push_back(std::make_pair(move, score));
   }
 }
 
-BlunderNet::BlunderNet(const std::string& model_path) {
-  net = torch::jit::load(model_path);
-}
-
-double BlunderNet::getEvaluation(const Position& pos, std::vector<std::pair<Move, float>>& policy) {
-  torch::Tensor input = inputToTensor(pos);
+double BlunderNet::getEvaluation(const Position& pos, const BoardBits* packed_planes, std::vector<std::pair<Move, float>>& policy) {
+  // skip autograd bookkeeping, we never train from C++
+  c10::InferenceMode guard;
+  torch::Tensor input = inputToTensor(&packed_planes, 1);
 
   auto output = net.forward({input});
 
@@ -211,3 +117,32 @@ double BlunderNet::getEvaluation(const Position& pos, std::vector<std::pair<Move
   }
   return value;
 }
+
+void BlunderNet::getEvaluations(std::span<BatchEntry> batch) {
+  if (batch.empty()) {
+    return;
+  }
+  c10::InferenceMode guard;
+  std::vector<const BoardBits*> packed_planes;
+  for (const BatchEntry& entry : batch) {
+    packed_planes.push_back(entry.packed_planes);
+  }
+  torch::Tensor input = inputToTensor(packed_planes.data(), batch.size());
+
+  auto output = net.forward({input});
+
+  torch::Tensor policy_tensor = output.toTuple()->elements()[0].toTensor();
+  policy_tensor = torch::nn::functional::softmax(
+      policy_tensor, torch::nn::functional::SoftmaxFuncOptions(1));
+  torch::Tensor value_tensor = output.toTuple()->elements()[1].toTensor().contiguous();
+  const float* values = value_tensor.data_ptr<float>();
+  for (size_t i = 0; i < batch.size(); i++) {
+    torch::Tensor row = policy_tensor[i];
+    policyTensorToMoves(row, batch[i].policy, *batch[i].pos);
+    batch[i].value = values[i];
+    // if we flipped board then we must also flip evaluation
+    if (batch[i].pos->getSideToMove() == Colour::Black) {
+      batch[i].value *= -1;
+    }
+  }
+}
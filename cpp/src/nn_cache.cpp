@@ -0,0 +1,69 @@
+#include <bit>
+
+#include "nn_cache.h"
+
+unsigned long long historyHash(const Position& pos) {
+  unsigned long long key = pos.getHash();
+  const Position* parent = pos.getParent();
+  // rotate each ancestor's hash by its distance from pos so the order of the
+  // history matters as well as its contents
+  for (int i = 1; i <= POS_HISTORY_LEN && parent != nullptr; i++) {
+    key ^= std::rotl(parent->getHash(), i * 7);
+    parent = parent->getParent();
+  }
+  return key;
+}
+
+NNCache::NNCache(size_t n_entries) : entries(std::bit_ceil(n_entries)) {}
+
+size_t NNCache::slotIndex(unsigned long long key) const {
+  // table size is a power of 2 so we can mask instead of mod
+  return key & (entries.size() - 1);
+}
+
+std::mutex& NNCache::slotLock(size_t slot_index) {
+  return locks[slot_index % NN_CACHE_N_STRIPES];
+}
+
+bool NNCache::lookup(unsigned long long key, float& value, std::vector<std::pair<Move, float>>& priors) {
+  size_t slot_index = slotIndex(key);
+  std::lock_guard<std::mutex> lock(slotLock(slot_index));
+  const Entry& entry = entries[slot_index];
+  if (!entry.occupied || entry.key != key) {
+    return false;
+  }
+
+  value = entry.value;
+  priors.clear();
+  priors.reserve(entry.priors.size());
+  for (const auto& [packed_move, prior] : entry.priors) {
+    priors.emplace_back(Move::unpack(packed_move), prior);
+  }
+  return true;
+}
+
+void NNCache::insert(unsigned long long key, float value, const std::vector<std::pair<Move, float>>& priors) {
+  size_t slot_index = slotIndex(key);
+  std::lock_guard<std::mutex> lock(slotLock(slot_index));
+  Entry& entry = entries[slot_index];
+  entry.key = key;
+  entry.occupied = true;
+  entry.value = value;
+  entry.priors.clear();
+  entry.priors.reserve(priors.size());
+  for (const auto& [move, prior] : priors) {
+    entry.priors.emplace_back(move.pack(), prior);
+  }
+}
+
+void NNCache::clear() {
+  for (size_t i = 0; i < entries.size(); i++) {
+    std::lock_guard<std::mutex> lock(slotLock(i));
+    entries[i].occupied = false;
+    entries[i].priors.clear();
+  }
+}
+
+size_t NNCache::size() const {
+  return entries.size();
+}
@@ -19,11 +19,42 @@ std::string Move::to_string(const Position& pos, bool minimal) const {
   return piece_name + " " + source_name + " " + dest_name;
 }
 
+std::string Move::toUCI() const {
+  std::string uci = indexToName(source) + indexToName(dest);
+  if (promotion != PieceType::None) {
+    uci += piece_to_string[Colour::Black][promotion];
+  }
+  return uci;
+}
+
 bool Move::operator==(const Move &other_move) const {
   return source == other_move.source && dest == other_move.dest &&
          move_type == other_move.move_type && promotion == other_move.promotion;
 }
 
+uint16_t Move::pack() const {
+  uint16_t flags;
+  if (promotion == PieceType::None) {
+    flags = move_type;
+  } else {
+    // promotions use the top half of the flags: bit 2 marks a capture and the
+    // low 2 bits store the piece from Knight to Queen
+    flags = 8 | ((move_type == MoveType::Capture) << 2) | (promotion - PieceType::Knight);
+  }
+  return source | (dest << 6) | (flags << 12);
+}
+
+Move Move::unpack(uint16_t packed) {
+  int source = packed & 0x3F;
+  int dest = (packed >> 6) & 0x3F;
+  int flags = packed >> 12;
+  if (flags & 8) {
+    MoveType move_type = (flags & 4) ? MoveType::Capture : MoveType::Quiet;
+    return Move(source, dest, move_type, static_cast<PieceType>((flags & 3) + PieceType::Knight));
+  }
+  return Move(source, dest, static_cast<MoveType>(flags));
+}
+
 void Position::clear() {
   for (int colour = Colour::White; colour <= Colour::Black; colour++) {
     for (int piece = PieceType::Pawn; piece <= PieceType::All; piece++) {
@@ -314,7 +345,12 @@ bool Position::isDrawByInsufficientMaterial() const {
 }
 
 bool Position::isDrawByRepetition() const {
-  return hash_cnt.find(hash.getHash())->second >= 3;
+  return getRepetitionCount() >= 3;
+}
+
+unsigned Position::getRepetitionCount() const {
+  auto it = hash_cnt.find(hash.getHash());
+  return (it != hash_cnt.end()) ? it->second : 0;
 }
 
 void Position::makeMove(const Move& move) {
@@ -398,36 +434,50 @@ Position Position::applyMove(const Move& move) const {
   return new_pos;
 }
 
+void Position::applyMoveInto(const Move& move, Position& out) const {
+  out = *this;
+  out.parent = this;
+  out.makeMove(move);
+}
+
+Position::Position(Uninitialised) : parent(nullptr), side_to_move(Colour::White), castling_rights{} {}
+
 Position Position::flip() const {
-  Position pos;
-  pos.all_pieces = all_pieces.flip(); 
-  pos.enpassant = all_pieces.flip();
+  Position pos(Uninitialised{});
+  flipInto(pos);
+  return pos;
+}
+
+void Position::flipInto(Position& out) const {
+  out.parent = nullptr;
+  out.all_pieces = all_pieces.flip();
+  out.enpassant = enpassant.flip();
+  // mirroring the board vertically turns white's pieces into black's and vice versa
   for (int colour = Colour::White; colour <= Colour::Black; colour++) {
-    // flip piece bitboards
-    for (int piece = PieceType::Pawn; piece <= PieceType::King; piece++) {
-      pos.bit_boards[colour][piece] = bit_boards[colour][piece].flip();
+    Colour flipped_colour = invertColour(static_cast<Colour>(colour));
+    for (int piece = PieceType::Pawn; piece <= PieceType::All; piece++) {
+      out.bit_boards[flipped_colour][piece] = bit_boards[colour][piece].flip();
     }
+    out.castling_rights[flipped_colour] = castling_rights[colour];
   }
-
-  // flip castling rights
-  bool tmp_white_kingside = castling_rights[Colour::White][CastlingType::Kingside];
-  bool tmp_white_queenside = castling_rights[Colour::White][CastlingType::Queenside];
-  pos.castling_rights[Colour::White][CastlingType::Kingside] = castling_rights[Colour::Black][CastlingType::Kingside];
-  pos.castling_rights[Colour::White][CastlingType::Queenside] = castling_rights[Colour::Black][CastlingType::Queenside];
-  pos.castling_rights[Colour::Black][CastlingType::Kingside] = tmp_white_kingside;
-  pos.castling_rights[Colour::Black][CastlingType::Queenside] = tmp_white_queenside;
-
-  pos.halfmove_clock = halfmove_clock;
-  pos.fullmove_cnt = fullmove_cnt;
-  // NOTE: flipping does not replicate the hash and the parent ptr because the hash wouldn't be
-  // valid for the flipped board and we shouldn't need the parent
-  return pos;
+  out.side_to_move = invertColour(side_to_move);
+
+  out.halfmove_clock = halfmove_clock;
+  out.fullmove_cnt = fullmove_cnt;
+  out.hash = hash.flipped();
+  // NOTE: the repetition history belongs to the unflipped game so it isn't
+  // carried over. clear() keeps the map's buckets so this doesn't allocate
+  out.hash_cnt.clear();
 }
 
 unsigned long long Position::getHash() const {
   return hash.getHash();
 }
 
+unsigned long long Position::getFlippedHash() const {
+  return hash.getFlippedHash();
+}
+
 void Position::makeCapture(const Move& move) {
   PieceType enemy_piece_type = getPieceType(invertColour(side_to_move), move.dest); 
   // capturing a rook can remove castling rights
@@ -0,0 +1,63 @@
+#include <chrono>
+
+#include "reclaimer.h"
+
+Reclaimer::Reclaimer() : thread(&Reclaimer::run, this) {}
+
+Reclaimer::~Reclaimer() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  work_cv.notify_one();
+  thread.join();
+}
+
+void Reclaimer::reclaim(std::unique_ptr<Arena> arena) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    queue.push_back(std::move(arena));
+  }
+  work_cv.notify_one();
+}
+
+void Reclaimer::wait() {
+  std::unique_lock<std::mutex> lock(mutex);
+  idle_cv.wait(lock, [this] { return queue.empty() && !busy; });
+}
+
+double Reclaimer::getReclaimSeconds() const {
+  return reclaim_ns / 1e9;
+}
+
+size_t Reclaimer::getBytesReclaimed() const {
+  return bytes_reclaimed;
+}
+
+void Reclaimer::run() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    work_cv.wait(lock, [this] { return stopping || !queue.empty(); });
+    // drain the queue before stopping so nothing leaks
+    if (queue.empty()) {
+      return;
+    }
+    std::unique_ptr<Arena> arena = std::move(queue.front());
+    queue.pop_front();
+    busy = true;
+    lock.unlock();
+
+    auto start = std::chrono::steady_clock::now();
+    size_t n_bytes = arena->bytesReserved();
+    arena.reset();
+    auto end = std::chrono::steady_clock::now();
+    reclaim_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    bytes_reclaimed += n_bytes;
+
+    lock.lock();
+    busy = false;
+    if (queue.empty()) {
+      idle_cv.notify_all();
+    }
+  }
+}
@@ -1,30 +1,662 @@
+#include <chrono>
+#include <cmath>
+#include <deque>
 #include <limits>
 #include <memory>
 #include <algorithm>
+#include <atomic>
+#include <unordered_map>
 #include <unordered_set>
+#include <thread>
 
 #include "search.h"
+#include "log.h"
 #include "move_generator.h"
 
+void SearchStats::merge(const SearchStats& other) {
+  nn_evaluations += other.nn_evaluations;
+  cache_lookups += other.cache_lookups;
+  cache_hits += other.cache_hits;
+  n_nodes += other.n_nodes;
+  n_pruned += other.n_pruned;
+  n_expansions += other.n_expansions;
+  n_transpositions += other.n_transpositions;
+  move_generations += other.move_generations;
+  n_collisions += other.n_collisions;
+  n_simulations += other.n_simulations;
+  n_batches += other.n_batches;
+}
+
+double SearchStats::cacheHitRate() const {
+  if (cache_lookups == 0) {
+    return 0;
+  }
+  return static_cast<double>(cache_hits) / cache_lookups;
+}
+
+double SearchStats::transpositionRate() const {
+  if (n_expansions == 0) {
+    return 0;
+  }
+  return static_cast<double>(n_transpositions) / n_expansions;
+}
+
+double SearchStats::reusedVisitFraction() const {
+  if (total_visits == 0) {
+    return 0;
+  }
+  return static_cast<double>(reused_visits) / total_visits;
+}
+
+double SearchStats::simulationsPerSecond() const {
+  if (search_seconds == 0) {
+    return 0;
+  }
+  return n_simulations / search_seconds;
+}
+
+double SearchStats::averageBatchSize() const {
+  if (n_batches == 0) {
+    return 0;
+  }
+  return static_cast<double>(nn_evaluations) / n_batches;
+}
+
+unsigned long long transpositionKey(const Position& pos) {
+  // mix in the repetition count so a position can't transpose into an
+  // earlier occurrence of itself, which would turn the graph into a cycle.
+  // NOTE: the history planes aren't part of the key, otherwise move order
+  // transpositions would never match. as in MCGS the evaluation of whichever
+  // path got there first is shared
+  return pos.getHash() ^ (pos.getRepetitionCount() * 0x9E3779B97F4A7C15ULL);
+}
+
+// node statistics are plain fields so nodes stay copyable and trivially
+// destructible. while simulations run they are only touched through these.
+// relaxed is enough for the counters, expansion_state orders everything else
+template <typename T>
+T loadAtomic(T& field) {
+  return std::atomic_ref<T>(field).load(std::memory_order_relaxed);
+}
+
+template <typename T>
+void addAtomic(T& field, T delta) {
+  std::atomic_ref<T>(field).fetch_add(delta, std::memory_order_relaxed);
+}
+
+// marks a node claimed by expandAndEvaluate or selectLeaf as expanded,
+// publishing its children and value to threads that load the state, and
+// wakes any threads waiting for it
+void publishExpansion(Node* node) {
+  std::atomic_ref<uint8_t> state(node->expansion_state);
+  state.store(ExpansionState::Expanded, std::memory_order_release);
+  state.notify_all();
+}
+
+// fills legal_priors with the priors in policy of legal_moves, renormalised.
+// the policy head has no outputs for castling or en passant so legal moves
+// it doesn't cover get MIN_POLICY_PROB, otherwise a position whose only move
+// is one of them would end up with no children
+void getLegalPriors(const std::vector<std::pair<Move, float>>& policy, const MoveVec& legal_moves, std::vector<std::pair<Move, float>>& legal_priors) {
+  std::unordered_set<Move> uncovered_moves(legal_moves.begin(), legal_moves.end());
+  float legal_priors_total = 0;
+  // iterate through all moves suggested by net's policy head but only keep
+  // the legal ones
+  for (const auto& move_prior : policy) {
+    if (uncovered_moves.erase(move_prior.first) > 0) {
+      legal_priors_total += move_prior.second;
+      legal_priors.push_back(move_prior);
+    }
+  }
+  for (const Move& move : uncovered_moves) {
+    legal_priors_total += MIN_POLICY_PROB;
+    legal_priors.emplace_back(move, MIN_POLICY_PROB);
+  }
+  if (legal_priors_total <= 0) {
+    return;
+  }
+
+  // renormalise probabilities using only legal moves
+  for (auto& move_prior : legal_priors) {
+    move_prior.second /= legal_priors_total;
+  }
+}
+
+GumbelMCTS::GumbelMCTS(Net* net, int simulation_budget, NNCache* cache, const SearchOptions& options)
+    : net(net), simulation_budget(simulation_budget), cache(cache), root_parallel(options.root_parallel),
+      batch_size(std::max(options.batch_size, 1)) {
+  int n_threads = std::max(options.n_threads, 1);
+  for (int i = 0; i < n_threads; i++) {
+    threads.push_back(std::make_unique<SearchThread>());
+  }
+  if (n_threads > 1) {
+    pool = std::make_unique<ThreadPool>(n_threads);
+  }
+}
+
+// sums the visits of the root's children, which is how many simulations the
+// root's subtree has had
+int countRootVisits(const Node* root) {
+  int n_visits = 0;
+  for (const Node& child : root->getChildren()) {
+    n_visits += child.visit_count;
+  }
+  return n_visits;
+}
+
 Move GumbelMCTS::getBestMove(const Position& pos) {
-  std::unique_ptr<Node> root = std::make_unique<Node>(pos, move_gen.generateMoves(pos));
-  expandAndEvaluate(root.get());  
+  deadline.reset();
+  return search(pos);
+}
+
+Move GumbelMCTS::getBestMove(const Position& pos, std::chrono::milliseconds time_budget) {
+  deadline = SearchClock::now() + time_budget;
+  return search(pos);
+}
+
+void GumbelMCTS::stop() {
+  stop_requested.store(true, std::memory_order_relaxed);
+}
+
+void GumbelMCTS::clearStop() {
+  stop_requested.store(false, std::memory_order_relaxed);
+}
+
+int GumbelMCTS::getSimulationsSoFar() const {
+  int n_simulations = 0;
+  for (const std::unique_ptr<SearchThread>& thread : threads) {
+    n_simulations += thread->progress.load(std::memory_order_relaxed);
+  }
+  return n_simulations;
+}
+
+std::optional<Move> GumbelMCTS::getBestCandidate() const {
+  int packed = best_candidate.load(std::memory_order_relaxed);
+  if (packed < 0) {
+    return std::nullopt;
+  }
+  return Move::unpack(packed);
+}
+
+std::optional<Move> GumbelMCTS::getExpectedReply(const Move& move) const {
+  if (tree_root == nullptr) {
+    return std::nullopt;
+  }
+  for (const Node& child : tree_root->getChildren()) {
+    if (!(child.getMove() == move)) {
+      continue;
+    }
+    const Node* reply = nullptr;
+    for (const Node& grandchild : child.getChildren()) {
+      if (reply == nullptr || grandchild.visit_count > reply->visit_count) {
+        reply = &grandchild;
+      }
+    }
+    if (reply == nullptr || reply->visit_count == 0) {
+      return std::nullopt;
+    }
+    return reply->getMove();
+  }
+  return std::nullopt;
+}
+
+bool GumbelMCTS::stopping() const {
+  return stop_requested.load(std::memory_order_relaxed);
+}
+
+bool GumbelMCTS::outOfSimulations() const {
+  return stopping() || (deadline && SearchClock::now() >= simulation_end);
+}
+
+Move GumbelMCTS::search(const Position& pos) {
+  SearchClock::time_point start = SearchClock::now();
+  best_candidate.store(-1, std::memory_order_relaxed);
+  measured_simulations = 0;
+  measured_seconds = 0;
+  n_root_ancestors = 0;
+  for (const Position* ancestor = pos.getParent();
+       ancestor != nullptr && n_root_ancestors < POS_HISTORY_LEN;
+       ancestor = ancestor->getParent()) {
+    root_ancestor_planes[n_root_ancestors++] = encodePiecePlanes(*ancestor);
+  }
+  PiecePlanes root_planes = encodePiecePlanes(pos);
+  for (std::unique_ptr<SearchThread>& thread : threads) {
+    thread->stats = SearchStats();
+    thread->progress.store(0, std::memory_order_relaxed);
+    if (thread->path.empty()) {
+      thread->path.emplace_back();
+      thread->path_planes.emplace_back();
+    }
+    thread->path[0] = pos;
+    thread->path_planes[0] = root_planes;
+  }
+  SearchThread& main_thread = *threads[0];
+
+  // carry on from the previous search's tree if pos is in it, otherwise
+  // start a new one
+  Node* root = reuseTree(pos);
+  bool reused = root != nullptr;
+  if (!reused) {
+    discardTree();
+    root = main_thread.arena->create<Node>();
+    main_thread.stats.n_nodes++;
+  }
+  expandAndEvaluate(main_thread, root, 0);  
+  if (reused) {
+    widenRoot(root);
+  }
+  if (root->n_children == 0) {
+    // mate or stalemate, there is nothing to search
+    stats = SearchStats();
+    tree_root = root;
+    tree_pos = pos;
+    return Move(0, 0, MoveType::Quiet);
+  }
+  int reused_visits = countRootVisits(root);
 
   std::vector<Node*> nodes_to_consider;
-  for (const std::unique_ptr<Node>& child : root->expanded_children) {
-    nodes_to_consider.push_back(child.get());
+  for (Node& child : root->getChildren()) {
+    nodes_to_consider.push_back(&child);
   }
 
   nodes_to_consider = getKGumbelArgtop(nodes_to_consider, std::min<int>(N_TO_CONSIDER, nodes_to_consider.size()));
-  for (Node*& child : nodes_to_consider) {
-    // NOTE: should this be negative?
-    root->value += -visit(child);
+  best_candidate.store(nodes_to_consider[0]->getMove().pack(), std::memory_order_relaxed);
+  if (deadline) {
+    simulation_end = *deadline;
   }
+  runAndMeasureSimulations(root, nodes_to_consider, 1);
 
   // NOTE: when we are training with self-play we will need to save the
   // completed Q-values somewhere
-  Node* best_move = applySequentialHalving(root.get(), nodes_to_consider);
-  return best_move->move;
+  Move best_move = applySequentialHalving(root, nodes_to_consider)->getMove();
+  stats = SearchStats();
+  for (const std::unique_ptr<SearchThread>& thread : threads) {
+    stats.merge(thread->stats);
+    stats.arena_bytes_used += thread->arena->bytesUsed();
+    stats.arena_bytes_reserved += thread->arena->bytesReserved();
+  }
+  stats.reused_visits = reused_visits;
+  stats.total_visits = countRootVisits(root);
+  stats.reclaim_seconds = reclaimer.getReclaimSeconds();
+  SearchClock::time_point end = SearchClock::now();
+  stats.search_seconds = std::chrono::duration<double>(end - start).count();
+  if (deadline && end > *deadline) {
+    stats.deadline_overshoot_seconds = std::chrono::duration<double>(end - *deadline).count();
+  }
+  // one line of key=value pairs so searches are easy to compare
+  LOG_INFO("search: move=%s simulations=%d seconds=%f simulations_per_second=%f "
+           "deadline_overshoot_seconds=%f threads=%zu batch_size=%d average_batch=%f "
+           "collisions=%d nn_evaluations=%d cache_lookups=%llu cache_hits=%llu "
+           "cache_hit_rate=%f move_generations=%d expansions=%d transpositions=%d "
+           "transposition_rate=%f nodes=%d pruned=%d arena_bytes_used=%zu "
+           "arena_bytes_reserved=%zu reused_visits=%d total_visits=%d "
+           "reused_visit_fraction=%f reclaim_seconds=%f\n",
+           best_move.toUCI().c_str(), stats.n_simulations, stats.search_seconds,
+           stats.simulationsPerSecond(), stats.deadline_overshoot_seconds, threads.size(),
+           batch_size, stats.averageBatchSize(), stats.n_collisions, stats.nn_evaluations,
+           stats.cache_lookups, stats.cache_hits, stats.cacheHitRate(), stats.move_generations,
+           stats.n_expansions, stats.n_transpositions, stats.transpositionRate(), stats.n_nodes,
+           stats.n_pruned, stats.arena_bytes_used, stats.arena_bytes_reserved,
+           stats.reused_visits, stats.total_visits, stats.reusedVisitFraction(),
+           stats.reclaim_seconds);
+
+  // keep the tree for the next search
+  tree_root = root;
+  tree_pos = pos;
+  return best_move;
+}
+
+void GumbelMCTS::resetTree() {
+  discardTree();
+}
+
+void GumbelMCTS::discardTree() {
+  tree_root = nullptr;
+  transpositions.clear();
+  subtree_transpositions.clear();
+  for (std::unique_ptr<SearchThread>& thread : threads) {
+    if (thread->arena->bytesReserved() > 0) {
+      reclaimer.reclaim(std::move(thread->arena));
+      thread->arena = std::make_unique<Arena>();
+    }
+  }
+}
+
+Node* GumbelMCTS::findSubtree(const Position& pos) {
+  if (tree_root == nullptr) {
+    return nullptr;
+  }
+  if (tree_pos.getHash() == pos.getHash()) {
+    return tree_root;
+  }
+  // normally pos is the old root plus our move and the opponent's reply
+  Position child_pos(tree_pos);
+  Position grandchild_pos(tree_pos);
+  for (Node& child : tree_root->getChildren()) {
+    tree_pos.applyMoveInto(child.getMove(), child_pos);
+    if (child_pos.getHash() == pos.getHash()) {
+      return &child;
+    }
+    for (Node& grandchild : child.getChildren()) {
+      child_pos.applyMoveInto(grandchild.getMove(), grandchild_pos);
+      if (grandchild_pos.getHash() == pos.getHash()) {
+        return &grandchild;
+      }
+    }
+  }
+  return nullptr;
+}
+
+// copies src and everything below it into arena, copying child arrays
+// shared by transpositions only once. returns the number of nodes copied
+int copySubtree(const Node& src, Node& dst, Arena& arena, std::unordered_map<const Node*, Node*>& copied_children) {
+  dst = src;
+  int n_nodes = 1;
+  if (src.n_children > 0) {
+    auto copied = copied_children.find(src.children);
+    if (copied != copied_children.end()) {
+      dst.children = copied->second;
+      return n_nodes;
+    }
+    dst.children = arena.createArray<Node>(src.n_children).data();
+    copied_children[src.children] = dst.children;
+    for (int i = 0; i < src.n_children; i++) {
+      n_nodes += copySubtree(src.children[i], dst.children[i], arena, copied_children);
+    }
+  }
+  return n_nodes;
+}
+
+Node* GumbelMCTS::reuseTree(const Position& pos) {
+  Node* subtree = findSubtree(pos);
+  tree_root = nullptr;
+  // a drawn node was left unexpanded below the root, so start again
+  if (subtree == nullptr || subtree->is_terminal) {
+    return nullptr;
+  }
+  // copy the subtree into a new arena and leave the old tree to the
+  // reclaimer
+  std::unique_ptr<Arena> new_arena = std::make_unique<Arena>();
+  Node* root = new_arena->create<Node>();
+  std::unordered_map<const Node*, Node*> copied_children;
+  threads[0]->stats.n_nodes += copySubtree(*subtree, *root, *new_arena, copied_children);
+  // the table points into the old arenas. we don't know the keys of the
+  // copied nodes so start it again
+  discardTree();
+  threads[0]->arena = std::move(new_arena);
+  return root;
+}
+
+void GumbelMCTS::widenRoot(Node* root) {
+  if (root->is_terminal || !root->isExpanded()) {
+    return;
+  }
+  root->n_widened = root->n_children;
+  // a reused root was expanded as an inner node, so moves below
+  // MIN_POLICY_PROB may have been pruned. the Gumbel top-k needs every move.
+  // every legal move gets a prior, see getLegalPriors, so the counts only
+  // differ if something was pruned and only then do we pay for an evaluation
+  SearchThread& thread = *threads[0];
+  const Position& pos = thread.path[0];
+  MoveVec legal_moves = move_gen.generateMoves(pos);
+  thread.stats.move_generations++;
+  if (static_cast<int>(legal_moves.size()) == root->n_children) {
+    return;
+  }
+
+  unsigned long long key = (cache != nullptr) ? historyHash(pos) : 0;
+  std::vector<std::pair<Move, float>> legal_priors;
+  float value;
+  if (!lookupCache(thread, key, value, legal_priors)) {
+    evaluate(thread, 0, key, legal_moves, legal_priors);
+  }
+  std::sort(legal_priors.begin(), legal_priors.end(),
+            [](const auto& lhs, const auto& rhs) { return lhs.second > rhs.second; });
+
+  // keep the statistics of the children we already have
+  std::span<Node> children = thread.arena->createArray<Node>(legal_priors.size());
+  for (size_t i = 0; i < legal_priors.size(); i++) {
+    uint16_t packed_move = legal_priors[i].first.pack();
+    auto existing = std::find_if(root->getChildren().begin(), root->getChildren().end(),
+                                 [packed_move](const Node& child) { return child.move == packed_move; });
+    if (existing != root->getChildren().end()) {
+      children[i] = *existing;
+    } else {
+      children[i].move = packed_move;
+      children[i].raw_prior = legal_priors[i].second;
+      thread.stats.n_nodes++;
+    }
+  }
+  root->children = children.data();
+  root->n_children = children.size();
+  root->n_widened = root->n_children;
+}
+
+void GumbelMCTS::runSimulations(Node* root, const std::vector<Node*>& children, int n_visits) {
+  if (n_visits <= 0) {
+    return;
+  }
+  // runs a simulation through each root child in simulations
+  auto simulate = [this, root](SearchThread& thread, std::span<Node* const> simulations) {
+    if (batch_size > 1) {
+      simulateBatched(thread, root, simulations);
+      return;
+    }
+    for (Node* child : simulations) {
+      if (outOfSimulations()) {
+        return;
+      }
+      // NOTE: should this be negative?
+      addAtomic(root->value, -visit(thread, child));
+      thread.stats.n_simulations++;
+      thread.progress.store(thread.stats.n_simulations, std::memory_order_relaxed);
+    }
+  };
+
+  if (pool != nullptr && root_parallel) {
+    // one task per child, so each subtree is only ever searched by one
+    // thread at a time. the tables are created up front as the map can't
+    // be changed while the tasks run
+    std::vector<TranspositionTable*> tables;
+    for (Node* child : children) {
+      tables.push_back(&subtree_transpositions[child]);
+    }
+    pool->run(children.size(), [&](int task, int thread_index) {
+      SearchThread& thread = *threads[thread_index];
+      thread.subtree_transpositions = tables[task];
+      std::vector<Node*> simulations(n_visits, children[task]);
+      simulate(thread, simulations);
+      thread.subtree_transpositions = nullptr;
+    });
+    return;
+  }
+
+  // interleave the children so simulations that run at the same time, in
+  // one batch or on different threads, start out in different subtrees
+  std::vector<Node*> simulations;
+  for (int i = 0; i < n_visits; i++) {
+    simulations.insert(simulations.end(), children.begin(), children.end());
+  }
+  if (pool == nullptr) {
+    simulate(*threads[0], simulations);
+    return;
+  }
+
+  // each task is one batch
+  int n_tasks = (simulations.size() + batch_size - 1) / batch_size;
+  pool->run(n_tasks, [&](int task, int thread_index) {
+    size_t first = task * batch_size;
+    size_t count = std::min<size_t>(batch_size, simulations.size() - first);
+    simulate(*threads[thread_index], std::span<Node* const>(simulations).subspan(first, count));
+  });
+}
+
+void GumbelMCTS::simulateBatched(SearchThread& thread, Node* root, std::span<Node* const> simulations) {
+  // each simulation runs until its leaf needs the net. once batch_size of
+  // them are waiting, or retrying after running into each other, the batch
+  // is evaluated and they carry on. counting the retries stops a tree with
+  // fewer than batch_size leaves to expand piling up simulations that can
+  // only collide
+  for (Node* child : simulations) {
+    // simulations already in flight hold claims on their leaves so they
+    // still have to finish below
+    if (outOfSimulations()) {
+      break;
+    }
+    simulate(thread, root, child);
+    if (thread.queue.inFlight() >= batch_size) {
+      runBatch(thread);
+    }
+  }
+  while (!thread.queue.empty()) {
+    runBatch(thread);
+  }
+}
+
+DetachedCoroutine GumbelMCTS::simulate(SearchThread& thread, Node* root, Node* child) {
+  SearchPath path;
+  PendingExpansion expansion;
+  SelectionResult result;
+  while ((result = selectLeaf(thread, child, path, expansion, false)) == SelectionResult::Collided) {
+    // waiting for the leaf it ran into could deadlock, so retry once the
+    // next batch is done
+    co_await thread.queue.nextBatch();
+  }
+
+  if (result == SelectionResult::NeedsEvaluation) {
+    // the thread's path is overwritten while we're suspended so keep our own
+    // copy of the leaf and its input
+    Position pos = thread.path[expansion.depth];
+    InputHistory history;
+    getInputHistory(thread, expansion.depth, history);
+    BoardBits packed_planes[N_INPUT_PLANES];
+    encodePackedInput(pos, history, packed_planes);
+
+    BatchEntry& evaluation = co_await thread.queue.evaluate(pos, packed_planes);
+    std::vector<std::pair<Move, float>> legal_priors;
+    getLegalPriors(evaluation.policy, expansion.legal_moves, legal_priors);
+    if (cache != nullptr) {
+      cache->insert(expansion.key, evaluation.value, legal_priors);
+    }
+    finishExpansion(thread, expansion, evaluation.value, legal_priors);
+    publishExpansion(expansion.node);
+  }
+
+  addAtomic(root->value, -backup(path));
+  thread.stats.n_simulations++;
+  thread.progress.store(thread.stats.n_simulations, std::memory_order_relaxed);
+}
+
+SelectionResult GumbelMCTS::selectLeaf(SearchThread& thread, Node* child, SearchPath& path, PendingExpansion& expansion, bool wait_for_expansions) {
+  path.size = 0;
+  pushPath(thread, 0, child->getMove());
+  Node* node = child;
+  int depth = 1;
+  while (true) {
+    path.nodes[path.size++] = node;
+    std::atomic_ref<uint8_t> state(node->expansion_state);
+    if (state.load(std::memory_order_acquire) == ExpansionState::Expanded) {
+      if (node->is_terminal || path.size == MAX_SEARCH_DEPTH) {
+        return SelectionResult::LeafReady;
+      }
+      widen(node);
+      Node* best_child = selectChild(node);
+      addAtomic(best_child->virtual_loss, VIRTUAL_LOSS);
+      pushPath(thread, depth, best_child->getMove());
+      node = best_child;
+      depth++;
+      continue;
+    }
+
+    uint8_t expected = ExpansionState::Unexpanded;
+    if (!state.compare_exchange_strong(expected, ExpansionState::Expanding, std::memory_order_acquire)) {
+      if (expected == ExpansionState::Expanded) {
+        // finished expanding since we looked, go round again
+        path.size--;
+        continue;
+      }
+      thread.stats.n_collisions++;
+      if (wait_for_expansions) {
+        // the visit then counts as one to the new leaf
+        state.wait(ExpansionState::Expanding, std::memory_order_acquire);
+        return SelectionResult::LeafReady;
+      }
+      for (int i = 0; i + 1 < path.size; i++) {
+        addAtomic(path.nodes[i + 1]->virtual_loss, -VIRTUAL_LOSS);
+      }
+      return SelectionResult::Collided;
+    }
+
+    if (prepareExpansion(thread, node, depth, expansion)) {
+      return SelectionResult::NeedsEvaluation;
+    }
+    publishExpansion(node);
+    return SelectionResult::LeafReady;
+  }
+}
+
+void GumbelMCTS::runBatch(SearchThread& thread) {
+  if (thread.queue.size() == 0) {
+    // only simulations that ran into leaves other threads are evaluating
+    std::this_thread::yield();
+  }
+  thread.queue.runBatch([this, &thread](std::span<BatchEntry> batch) {
+    if (net->isThreadSafe()) {
+      net->getEvaluations(batch);
+    } else {
+      std::lock_guard<std::mutex> lock(net_mutex);
+      net->getEvaluations(batch);
+    }
+    thread.stats.nn_evaluations += batch.size();
+    thread.stats.n_batches++;
+  });
+}
+
+float GumbelMCTS::backup(const SearchPath& path) {
+  Node* leaf = path.leaf();
+  addAtomic(leaf->visit_count, 1);
+  float value = loadAtomic(leaf->value);
+  for (int i = path.size - 2; i >= 0; i--) {
+    Node* node = path.nodes[i];
+    addAtomic(path.nodes[i + 1]->virtual_loss, -VIRTUAL_LOSS);
+    // TODO: double check this should be negative
+    addAtomic(node->value, -value);
+    addAtomic(node->visit_count, 1);
+    value = loadAtomic(node->value);
+  }
+  return value;
+}
+
+void GumbelMCTS::runAndMeasureSimulations(Node* root, const std::vector<Node*>& children, int n_visits) {
+  SearchClock::time_point start = SearchClock::now();
+  // count what actually ran, simulations stop early once out of time
+  int n_simulations = getSimulationsSoFar();
+  runSimulations(root, children, n_visits);
+  measured_simulations += getSimulationsSoFar() - n_simulations;
+  measured_seconds += std::chrono::duration<double>(SearchClock::now() - start).count();
+}
+
+void GumbelMCTS::runSimulationsUntil(Node* root, const std::vector<Node*>& children, SearchClock::time_point end) {
+  simulation_end = end;
+  while (true) {
+    SearchClock::time_point now = SearchClock::now();
+    if (now >= end || stopping()) {
+      return;
+    }
+    // size the chunk from the rate so far to finish by end or the next
+    // clock check
+    double seconds = std::chrono::duration<double>(std::min<SearchClock::duration>(end - now, TIME_CHECK_INTERVAL)).count();
+    double rate = (measured_seconds > 0) ? measured_simulations / measured_seconds : 0;
+    int n_visits = std::max<int>(rate * seconds / children.size(), 1);
+    runAndMeasureSimulations(root, children, n_visits);
+  }
+}
+
+TranspositionTable& GumbelMCTS::getTranspositions(SearchThread& thread) {
+  if (thread.subtree_transpositions != nullptr) {
+    return *thread.subtree_transpositions;
+  }
+  return transpositions;
 }
 
 // comparison func to sort nodes into descending order of processed_prior
@@ -35,16 +667,16 @@ bool nodeCompare(Node* lhs, Node* rhs) {
 std::vector<Node*> GumbelMCTS::getKGumbelArgtop(std::vector<Node*>& input_nodes, int k) {
   std::vector<Node*> nodes_to_consider;
   // add logit(move) + gumbel_variable
-  printf("getKGumbelArgtop\n");
+  LOG_DEBUG("getKGumbelArgtop\n");
   for (Node* child : input_nodes) {
     // store the gumbel variable we applied to "avoid double-counting bias" (Danihelka, 2022)
     child->applied_gumbel = 0.5; // gumbel_dist(gen);  TODO: REVERT!!!
     child->score = child->raw_prior + child->applied_gumbel;
     nodes_to_consider.push_back(child);
 
-    printf("move: %s raw_prior: %f gumbel: %f value: %f score: %f\n",
-            child->move.to_string(*input_nodes[0]->pos.getParent(), true).c_str(), child->raw_prior,
-            child->applied_gumbel, child->value, child->score);
+    LOG_TRACE("move: %s raw_prior: %f gumbel: %f value: %f score: %f\n",
+              child->getMove().toUCI().c_str(), child->raw_prior,
+              child->applied_gumbel, child->value, child->score);
   }
   
   // retain only the best k moves
@@ -58,123 +690,306 @@ Node* GumbelMCTS::applySequentialHalving(Node* root, std::vector<Node*>& nodes_t
   // repeatedly halve the number of nodes we're considering until we only have 1
   // remaining
   while (nodes_to_consider.size() > 1) {
-    printf("\n\nn_simulations remaining: %d\n", n_simulations);
-    // number of times to visit each node under consideration
-    int n_visits_per_node = n_simulations / (std::log(nodes_to_consider.size()) * nodes_to_consider.size());
+    // the threads share out every visit of a round and it only ends once
+    // they are all done, so the halving below sees final values
+    if (deadline) {
+      // split the time left equally between the remaining rounds. a round
+      // that starts after the deadline runs nothing, so we still halve down
+      // to a move straight away
+      int n_rounds = 0;
+      for (size_t n_nodes = nodes_to_consider.size(); n_nodes > 1; n_nodes /= 2) {
+        n_rounds++;
+      }
+      SearchClock::time_point now = SearchClock::now();
+      SearchClock::time_point round_end = (now < *deadline) ? now + (*deadline - now) / n_rounds : now;
+      LOG_DEBUG("\n\ntime remaining: %f s\n", std::chrono::duration<double>(*deadline - now).count());
+      runSimulationsUntil(root, nodes_to_consider, round_end);
+    } else {
+      LOG_DEBUG("\n\nn_simulations remaining: %d\n", n_simulations);
+      // number of times to visit each node under consideration
+      int n_visits_per_node = n_simulations / (std::log(nodes_to_consider.size()) * nodes_to_consider.size());
+      runSimulations(root, nodes_to_consider, n_visits_per_node);
+      n_simulations -= std::max(n_visits_per_node, 0) * static_cast<int>(nodes_to_consider.size());
+    }
     int max_visit_cnt = std::numeric_limits<int>::min();
     for (Node* child : nodes_to_consider) {
-      for (int i = 0; i < n_visits_per_node; i++) {
-        root->value += -visit(child);
-        n_simulations--;
-      }
       max_visit_cnt = std::max(max_visit_cnt, child->visit_count);
     }
 
     // NOTE: unsure if this is needed
     // if we have left over simulations on the final iteration due to rounding,
     // spend the remaining budget
-    if (nodes_to_consider.size() == 2 || nodes_to_consider.size() == 3 && n_simulations > 0) {
+    if (!deadline && !stopping() && (nodes_to_consider.size() == 2 || nodes_to_consider.size() == 3 && n_simulations > 0)) {
         int remaining_visits = n_simulations / nodes_to_consider.size();
-        for (Node* child : nodes_to_consider) {
-          for (int i = 0; i < remaining_visits; i++) {
-            root->value += -visit(child);
-          }
-        }
+        runSimulations(root, nodes_to_consider, remaining_visits);
     }
 
     for (Node* child : nodes_to_consider) {
       // calculate σ(ˆq(a))
       double sigma_qhat = (C_VISIT + max_visit_cnt) * (C_SCALE * -child->value);
       child->score = child->raw_prior + child->applied_gumbel + sigma_qhat;
-      printf("move: %s raw_prior: %f gumbel: %f value: %f score: %f\n",
-             child->move.to_string(root->pos, true).c_str(), child->raw_prior,
-             child->applied_gumbel, child->value, child->score);
+      LOG_TRACE("move: %s raw_prior: %f gumbel: %f value: %f score: %f\n",
+                child->getMove().toUCI().c_str(), child->raw_prior,
+                child->applied_gumbel, child->value, child->score);
     }
 
-    // remove the worst half
+    // remove the worst half, or all but the best if we've been stopped
     std::sort(nodes_to_consider.begin(), nodes_to_consider.end(), nodeCompare);
-    nodes_to_consider.resize(static_cast<int>(nodes_to_consider.size() / 2));
+    if (stopping()) {
+      nodes_to_consider.resize(1);
+    } else {
+      nodes_to_consider.resize(static_cast<int>(nodes_to_consider.size() / 2));
+    }
+    best_candidate.store(nodes_to_consider[0]->getMove().pack(), std::memory_order_relaxed);
   }
 
   return nodes_to_consider[0];
 }
 
-void GumbelMCTS::expandAndEvaluate(Node* node) {
-  // return if we've already expanded this node
-  if (node->expanded_children.size() > 0) {
+void GumbelMCTS::expandAndEvaluate(SearchThread& thread, Node* node, int depth) {
+  // claim the node so only one thread expands it. a thread arriving while
+  // it's being expanded waits and then counts as a visit to the new leaf
+  std::atomic_ref<uint8_t> state(node->expansion_state);
+  uint8_t expected = ExpansionState::Unexpanded;
+  if (!state.compare_exchange_strong(expected, ExpansionState::Expanding, std::memory_order_acquire)) {
+    if (expected == ExpansionState::Expanding) {
+      thread.stats.n_collisions++;
+      state.wait(ExpansionState::Expanding, std::memory_order_acquire);
+    }
     return;
   }
 
-  // expand node
-  MoveVec legal_moves = move_gen.generateMoves(node->pos);
+  expandNode(thread, node, depth);
+  publishExpansion(node);
+}
+
+void GumbelMCTS::expandNode(SearchThread& thread, Node* node, int depth) {
+  PendingExpansion expansion;
+  if (!prepareExpansion(thread, node, depth, expansion)) {
+    return;
+  }
+  // otherwise evaluate position and add nodes for the legal moves
+  std::vector<std::pair<Move, float>> legal_priors;
+  float value = evaluate(thread, depth, expansion.key, expansion.legal_moves, legal_priors);
+  finishExpansion(thread, expansion, value, legal_priors);
+}
+
+bool GumbelMCTS::prepareExpansion(SearchThread& thread, Node* node, int depth, PendingExpansion& expansion) {
+  const Position& pos = thread.path[depth];
+  expansion.node = node;
+  expansion.depth = depth;
+  // if another path through the tree has already expanded this position
+  // share its children and evaluation instead of expanding it again. the
+  // table only holds positions with legal moves but a transposition with a
+  // different halfmove clock could still be a draw
+  expansion.transposition_key = transpositionKey(pos);
+  TranspositionTable& table = getTranspositions(thread);
+  if (!pos.isDraw()) {
+    // a subtree's table is only used by the thread searching the subtree
+    std::unique_lock<std::mutex> lock(transpositions_mutex, std::defer_lock);
+    if (&table == &transpositions) {
+      lock.lock();
+    }
+    auto transposition = table.find(expansion.transposition_key);
+    if (transposition != table.end()) {
+      const TranspositionEntry& entry = transposition->second;
+      node->value = entry.value;
+      node->children = entry.children;
+      node->n_children = entry.n_children;
+      node->n_widened = (depth == 0) ? node->n_children : std::min<int>(node->n_children, MIN_WIDENED_CHILDREN);
+      thread.stats.n_expansions++;
+      thread.stats.n_transpositions++;
+      return false;
+    }
+  }
+
+  expansion.key = (cache != nullptr) ? historyHash(pos) : 0;
+  std::vector<std::pair<Move, float>> legal_priors;
+  float value;
+  // a cached evaluation already has the legal moves so we only generate them
+  // on a miss. positions only get cached if they have legal moves so a hit
+  // can't be checkmate or stalemate
+  bool cached = lookupCache(thread, expansion.key, value, legal_priors);
+  MoveVec& legal_moves = expansion.legal_moves;
+  legal_moves.clear();
+  if (!cached) {
+    legal_moves = move_gen.generateMoves(pos);
+    thread.stats.move_generations++;
+  }
 
   // if we have no legal moves we must be checkmated or stalemated
-  if (legal_moves.size() == 0) {
+  if (!cached && legal_moves.size() == 0) {
     // if not legal moves and king is in check then we have checkmate
-    if (move_gen.isCheck(node->pos)) {
+    if (move_gen.isCheck(pos)) {
       node->value = -1;
     } else {
       // otherwise must be stalemate
       node->value = 0;
     }
     node->is_terminal = true;
-    return;
+    return false;
   }
 
-  // if it's a draw
-  if (node->pos.isDraw()) {
+  // if it's a draw. the root is still searched so there is a move to play
+  if (depth > 0 && pos.isDraw()) {
     node->is_terminal = true;
     node->value = 0;
-    return;
+    return false;
   }
 
-  // otherwise evaluate position and add nodes for policy head's suggested moves
-  std::unordered_set<Move> legal_move_set(legal_moves.begin(), legal_moves.end());
-  std::vector<std::pair<Move, float>> moves_and_priors;
-  // save the value head's evaluation of the position
-  node->value = net->getEvaluation(node->pos, moves_and_priors);
-  float legal_priors_total = 0;
-  // iterate through all moves suggested by net's policy head 
-  for (const auto& move_prior : moves_and_priors) {
-    // but only add nodes for the legal moves suggested by policy head
-    if (legal_move_set.find(move_prior.first) != legal_move_set.end()) {
-      legal_priors_total += move_prior.second;
-      Position new_pos = node->pos.applyMove(move_prior.first);
-      node->expanded_children.emplace_back(
-          std::make_unique<Node>(move_prior.second, new_pos, move_prior.first,
-                                 false, move_gen.generateMoves(new_pos)));
+  if (cached) {
+    finishExpansion(thread, expansion, value, legal_priors);
+    return false;
+  }
+  return true;
+}
+
+void GumbelMCTS::finishExpansion(SearchThread& thread, const PendingExpansion& expansion, float value, std::vector<std::pair<Move, float>>& legal_priors) {
+  Node* node = expansion.node;
+  node->value = value;
+
+  // sort the children by prior so progressive widening only has to track
+  // how many of them are searched
+  std::sort(legal_priors.begin(), legal_priors.end(),
+            [](const auto& lhs, const auto& rhs) { return lhs.second > rhs.second; });
+  size_t n_children = legal_priors.size();
+  // below the root leave out moves the policy considers hopeless, keeping at
+  // least the best one. the root keeps every move for the Gumbel top-k
+  if (expansion.depth > 0) {
+    while (n_children > 1 && legal_priors[n_children - 1].second < MIN_POLICY_PROB) {
+      n_children--;
     }
   }
+  thread.stats.n_pruned += legal_priors.size() - n_children;
 
-  // renormalise probabilities using only legal moves
-  for (const auto& child: node->expanded_children) {
-    child->raw_prior /= legal_priors_total;
+  std::span<Node> children = thread.arena->createArray<Node>(n_children);
+  for (size_t i = 0; i < n_children; i++) {
+    children[i].move = legal_priors[i].first.pack();
+    children[i].raw_prior = legal_priors[i].second;
   }
+  thread.stats.n_nodes += children.size();
+  node->children = children.data();
+  node->n_children = children.size();
+  node->n_widened = (expansion.depth == 0) ? node->n_children : std::min<int>(node->n_children, MIN_WIDENED_CHILDREN);
+  thread.stats.n_expansions++;
+  // NOTE: another thread may have expanded the same position meanwhile, the
+  // last one in wins the entry
+  TranspositionTable& table = getTranspositions(thread);
+  std::unique_lock<std::mutex> lock(transpositions_mutex, std::defer_lock);
+  if (&table == &transpositions) {
+    lock.lock();
+  }
+  table[expansion.transposition_key] = TranspositionEntry{node->children, node->n_children, node->value};
 }
 
-// NOTE: when I make this multi-threaded I suspect this would be the place to start
-int GumbelMCTS::visit(Node* node) {
-  // if the node is unexpanded, expand it
-  if (node->expanded_children.size() == 0) {
-    expandAndEvaluate(node);
-  } else {
-    // otherwise find the best child and visit it
-    node->visit_count++;
-    Node* best_child = nullptr;
-    float cur_highest_score = -std::numeric_limits<float>::max();
-    for (const auto& child : node->expanded_children) {
-      // using both the prior and ratio
-      // NOTE: very unsure whether I should be using child->raw_prior or child->value here
-      float score = child->raw_prior - child->visit_count / static_cast<float>(node->visit_count);
-      if (score > cur_highest_score) {
-        cur_highest_score = score;
-        best_child = child.get();
-      }
+void GumbelMCTS::widen(Node* node) {
+  int n_widened = std::ceil(WIDENING_COEFF * std::pow(loadAtomic(node->visit_count), WIDENING_EXPONENT));
+  n_widened = std::min<int>(node->n_children, std::max(n_widened, MIN_WIDENED_CHILDREN));
+  // only ever grows, whichever thread gets there first
+  std::atomic_ref<uint16_t> cur_widened(node->n_widened);
+  uint16_t expected = cur_widened.load(std::memory_order_relaxed);
+  while (expected < n_widened &&
+         !cur_widened.compare_exchange_weak(expected, n_widened, std::memory_order_relaxed)) {}
+}
+
+Node* GumbelMCTS::selectChild(Node* node) {
+  Node* best_child = nullptr;
+  float cur_highest_score = -std::numeric_limits<float>::max();
+  // visits are only counted on backup, so an expanded node can still have
+  // none while its first simulations are in flight
+  float node_visits = std::max(loadAtomic(node->visit_count) + loadAtomic(node->virtual_loss), 1);
+  uint16_t n_widened = loadAtomic(node->n_widened);
+  for (Node& child : node->getChildren().first(n_widened)) {
+    // using both the prior and ratio. in flight simulations count as visits
+    // NOTE: very unsure whether I should be using child->raw_prior or child->value here
+    int child_visits = loadAtomic(child.visit_count) + loadAtomic(child.virtual_loss);
+    float score = child.raw_prior - child_visits / node_visits;
+    if (score > cur_highest_score) {
+      cur_highest_score = score;
+      best_child = &child;
     }
-    // TODO: double check this should be negative
-    node->value += -visit(best_child);
   }
+  return best_child;
+}
+
+void GumbelMCTS::pushPath(SearchThread& thread, int depth, const Move& move) {
+  if (depth + 1 == static_cast<int>(thread.path.size())) {
+    thread.path.emplace_back();
+    thread.path_planes.emplace_back();
+  }
+  thread.path[depth].applyMoveInto(move, thread.path[depth + 1]);
+}
+
+void GumbelMCTS::getInputHistory(SearchThread& thread, int depth, InputHistory& history) const {
+  int i = 0;
+  for (; i <= POS_HISTORY_LEN && depth - i >= 0; i++) {
+    // the root's planes are encoded once per search
+    if (depth - i > 0) {
+      thread.path_planes[depth - i] = encodePiecePlanes(thread.path[depth - i]);
+    }
+    history[i] = &thread.path_planes[depth - i];
+  }
+  // once we run out of nodes carry on into the positions before the root
+  for (int j = 0; i <= POS_HISTORY_LEN && j < n_root_ancestors; i++, j++) {
+    history[i] = &root_ancestor_planes[j];
+  }
+  for (; i <= POS_HISTORY_LEN; i++) {
+    history[i] = nullptr;
+  }
+}
+
+bool GumbelMCTS::lookupCache(SearchThread& thread, unsigned long long key, float& value, std::vector<std::pair<Move, float>>& legal_priors) {
+  if (cache == nullptr) {
+    return false;
+  }
+  thread.stats.cache_lookups++;
+  if (cache->lookup(key, value, legal_priors)) {
+    thread.stats.cache_hits++;
+    return true;
+  }
+  return false;
+}
+
+float GumbelMCTS::evaluate(SearchThread& thread, int depth, unsigned long long key, const MoveVec& legal_moves, std::vector<std::pair<Move, float>>& legal_priors) {
+  const Position& pos = thread.path[depth];
+  // only the last POS_HISTORY_LEN + 1 positions of the path are encoded,
+  // whatever the depth
+  InputHistory history;
+  getInputHistory(thread, depth, history);
+  BoardBits packed_planes[N_INPUT_PLANES];
+  encodePackedInput(pos, history, packed_planes);
+
+  std::vector<std::pair<Move, float>> moves_and_priors;
+  // save the value head's evaluation of the position
+  float value;
+  if (net->isThreadSafe()) {
+    value = net->getEvaluation(pos, packed_planes, moves_and_priors);
+  } else {
+    std::lock_guard<std::mutex> lock(net_mutex);
+    value = net->getEvaluation(pos, packed_planes, moves_and_priors);
+  }
+  thread.stats.nn_evaluations++;
+  thread.stats.n_batches++;
+  getLegalPriors(moves_and_priors, legal_moves, legal_priors);
+
+  if (cache != nullptr) {
+    cache->insert(key, value, legal_priors);
+  }
+  return value;
+}
+
+float GumbelMCTS::visit(SearchThread& thread, Node* child) {
+  SearchPath path;
+  PendingExpansion expansion;
+  if (selectLeaf(thread, child, path, expansion, true) == SelectionResult::NeedsEvaluation) {
+    std::vector<std::pair<Move, float>> legal_priors;
+    float value = evaluate(thread, expansion.depth, expansion.key, expansion.legal_moves, legal_priors);
+    finishExpansion(thread, expansion, value, legal_priors);
+    publishExpansion(expansion.node);
+  }
+  return backup(path);
+}
 
-  node->visit_count++;
-  return node->value;
+const SearchStats& GumbelMCTS::getStats() const {
+  return stats;
 }
\ No newline at end of file
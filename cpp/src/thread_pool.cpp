@@ -0,0 +1,62 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(int n_threads) {
+  for (int i = 0; i < n_threads; i++) {
+    threads.emplace_back(&ThreadPool::work, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  work_cv.notify_all();
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+}
+
+int ThreadPool::size() const {
+  return threads.size();
+}
+
+void ThreadPool::run(int n_tasks, const std::function<void(int, int)>& task) {
+  if (n_tasks <= 0) {
+    return;
+  }
+  std::unique_lock<std::mutex> lock(mutex);
+  cur_task = &task;
+  this->n_tasks = n_tasks;
+  next_task = 0;
+  n_busy = threads.size();
+  batch++;
+  work_cv.notify_all();
+  done_cv.wait(lock, [this] { return n_busy == 0; });
+  cur_task = nullptr;
+}
+
+void ThreadPool::work(int thread_index) {
+  unsigned long long last_batch = 0;
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    work_cv.wait(lock, [this, last_batch] { return stopping || batch != last_batch; });
+    if (stopping) {
+      return;
+    }
+    last_batch = batch;
+    const std::function<void(int, int)>& task = *cur_task;
+    int batch_size = n_tasks;
+    lock.unlock();
+
+    // take tasks one at a time so uneven tasks still balance
+    for (int i = next_task++; i < batch_size; i = next_task++) {
+      task(i, thread_index);
+    }
+
+    lock.lock();
+    if (--n_busy == 0) {
+      done_cv.notify_one();
+    }
+  }
+}
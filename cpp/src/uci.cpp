@@ -0,0 +1,314 @@
+#include <algorithm>
+
+#include "uci.h"
+
+std::optional<Move> parseUCIMove(MoveGenerator& move_gen, const Position& pos, const std::string& uci) {
+  for (const Move& move : move_gen.generateMoves(pos)) {
+    if (move.toUCI() == uci) {
+      return move;
+    }
+  }
+  return std::nullopt;
+}
+
+UCIEngine::UCIEngine(Net* net, std::ostream& out, NNCache* cache, const SearchOptions& options)
+    : searcher(net, N_SIMULATIONS, cache, options), cache(cache), out(out) {
+  game.emplace_back();
+}
+
+UCIEngine::~UCIEngine() {
+  stopSearch();
+  waitForSearch();
+}
+
+void UCIEngine::loop(std::istream& in) {
+  std::string line;
+  while (std::getline(in, line) && handleCommand(line)) {
+  }
+}
+
+bool UCIEngine::handleCommand(const std::string& line) {
+  SearchClock::time_point received = SearchClock::now();
+  std::istringstream args(line);
+  std::string command;
+  args >> command;
+  if (command == "uci") {
+    send("id name blunder-bot");
+    send("id author Adam Dayan");
+    send("option name Ponder type check default false");
+    send("uciok");
+  } else if (command == "isready") {
+    // the search has its own thread so this is answered even mid-search
+    send("readyok");
+    sendLatency("isready", received);
+  } else if (command == "debug") {
+    std::string mode;
+    args >> mode;
+    debug = mode == "on";
+  } else if (command == "setoption") {
+    setOption(args);
+  } else if (command == "ponderhit") {
+    ponderHit(received);
+  } else if (command == "stop") {
+    {
+      std::lock_guard<std::mutex> lock(search_mutex);
+      if (searching) {
+        stop_received = received;
+      }
+    }
+    stopSearch();
+  } else if (command == "quit") {
+    stopSearch();
+    waitForSearch();
+    return false;
+  } else if (command == "ucinewgame" || command == "position" || command == "go") {
+    // the GUI should have stopped any search already but the search reads
+    // the game so make sure
+    stopSearch();
+    waitForSearch();
+    if (command == "ucinewgame") {
+      searcher.resetTree();
+      if (cache != nullptr) {
+        cache->clear();
+      }
+      game.clear();
+      game.emplace_back();
+    } else if (command == "position") {
+      setPosition(args);
+    } else {
+      go(args);
+    }
+  }
+  // anything else is ignored, as the protocol asks
+  return true;
+}
+
+void UCIEngine::waitForSearch() {
+  if (search_thread.joinable()) {
+    search_thread.join();
+  }
+  if (info_thread.joinable()) {
+    info_thread.join();
+  }
+}
+
+const std::deque<Position>& UCIEngine::getGame() const {
+  return game;
+}
+
+void UCIEngine::setOption(std::istringstream& args) {
+  std::string token;
+  std::string name;
+  args >> token;
+  while (args >> token && token != "value") {
+    name += (name.empty() ? "" : " ") + token;
+  }
+  std::string value;
+  args >> value;
+  if (name == "Ponder") {
+    ponder_option = value == "true";
+  }
+}
+
+void UCIEngine::setPosition(std::istringstream& args) {
+  std::string token;
+  args >> token;
+  std::string fen;
+  if (token == "startpos") {
+    fen = start_position;
+    args >> token;
+  } else if (token == "fen") {
+    while (args >> token && token != "moves") {
+      fen += token + " ";
+    }
+  } else {
+    return;
+  }
+
+  game.clear();
+  game.emplace_back(fen);
+  if (token != "moves") {
+    return;
+  }
+  while (args >> token) {
+    std::optional<Move> move = parseUCIMove(move_gen, game.back(), token);
+    if (!move) {
+      send("info string illegal move " + token);
+      return;
+    }
+    game.push_back(game.back().applyMove(*move));
+  }
+}
+
+void UCIEngine::go(std::istringstream& args) {
+  bool ponder = false;
+  bool infinite = false;
+  std::chrono::milliseconds time_budget = getTimeBudget(args, ponder, infinite);
+  if (ponder) {
+    // the clock only starts on ponderhit, until then search indefinitely
+    ponder_hit_budget = time_budget;
+    ponder_hit_infinite = infinite;
+    startSearch(UCI_INFINITE_BUDGET, true, false);
+  } else {
+    startSearch(time_budget, false, infinite);
+  }
+}
+
+void UCIEngine::ponderHit(SearchClock::time_point received) {
+  {
+    std::lock_guard<std::mutex> lock(search_mutex);
+    if (!searching || !pondering) {
+      return;
+    }
+    ponder_hit = true;
+  }
+  // the opponent played the reply we pondered on. the pondering search
+  // stops without a bestmove and the real one reuses its tree, so the time
+  // spent pondering counts towards this move
+  stopSearch();
+  waitForSearch();
+  startSearch(ponder_hit_budget, false, ponder_hit_infinite);
+  sendLatency("ponderhit", received);
+}
+
+void UCIEngine::startSearch(std::chrono::milliseconds time_budget, bool ponder, bool infinite) {
+  // clear the last search's stop here rather than in the search so a stop
+  // sent straight after go can't be lost
+  searcher.clearStop();
+  {
+    std::lock_guard<std::mutex> lock(search_mutex);
+    searching = true;
+    pondering = ponder;
+    ponder_hit = false;
+    hold_bestmove = ponder || infinite;
+    release_bestmove = false;
+    search_start = SearchClock::now();
+    stop_received.reset();
+  }
+  search_thread = std::thread(&UCIEngine::search, this, time_budget);
+  info_thread = std::thread(&UCIEngine::reportProgress, this);
+}
+
+void UCIEngine::stopSearch() {
+  {
+    std::lock_guard<std::mutex> lock(search_mutex);
+    release_bestmove = true;
+  }
+  search_cv.notify_all();
+  searcher.stop();
+}
+
+std::chrono::milliseconds UCIEngine::getTimeBudget(std::istringstream& args, bool& ponder, bool& infinite) const {
+  std::optional<int> movetime;
+  std::optional<int> time_left;
+  int increment = 0;
+  int moves_to_go = UCI_DEFAULT_MOVES_TO_GO;
+  Colour side_to_move = game.back().getSideToMove();
+  std::string token;
+  while (args >> token) {
+    int value = 0;
+    if (token == "infinite") {
+      infinite = true;
+      continue;
+    } else if (token == "ponder") {
+      ponder = true;
+      continue;
+    } else if (!(args >> value)) {
+      break;
+    }
+    if (token == "movetime") {
+      movetime = value;
+    } else if (token == (side_to_move == Colour::White ? "wtime" : "btime")) {
+      time_left = value;
+    } else if (token == (side_to_move == Colour::White ? "winc" : "binc")) {
+      increment = value;
+    } else if (token == "movestogo") {
+      moves_to_go = std::max(value, 1);
+    }
+  }
+
+  if (infinite) {
+    return UCI_INFINITE_BUDGET;
+  }
+  std::chrono::milliseconds budget;
+  if (movetime) {
+    budget = std::chrono::milliseconds(*movetime) - UCI_MOVE_OVERHEAD;
+  } else if (time_left) {
+    // an even share of the clock plus most of the increment, never more
+    // than is left on the clock
+    budget = std::chrono::milliseconds(std::min(*time_left / moves_to_go + increment * 3 / 4, *time_left)) - UCI_MOVE_OVERHEAD;
+  } else {
+    // bare go, or go with limits we don't understand such as depth or nodes
+    return UCI_DEFAULT_MOVETIME;
+  }
+  return std::max(budget, std::chrono::milliseconds(1));
+}
+
+void UCIEngine::search(std::chrono::milliseconds time_budget) {
+  Move best_move = searcher.getBestMove(game.back(), time_budget);
+  std::optional<SearchClock::time_point> stopped;
+  bool restarting = false;
+  {
+    std::unique_lock<std::mutex> lock(search_mutex);
+    search_cv.wait(lock, [this] { return !hold_bestmove || release_bestmove; });
+    searching = false;
+    stopped = stop_received;
+    restarting = ponder_hit;
+  }
+  search_cv.notify_all();
+  if (restarting) {
+    return;
+  }
+
+  // the search returns the null move when mated or stalemated, which UCI
+  // writes as 0000
+  bool null_move = best_move.source == best_move.dest;
+  const SearchStats& stats = searcher.getStats();
+  std::string info = "info time " + std::to_string(static_cast<int>(stats.search_seconds * 1000)) +
+                     " nodes " + std::to_string(stats.n_simulations) +
+                     " nps " + std::to_string(static_cast<int>(stats.simulationsPerSecond()));
+  if (!null_move) {
+    info += " pv " + best_move.toUCI();
+  }
+  send(info);
+  std::string line = "bestmove " + (null_move ? std::string("0000") : best_move.toUCI());
+  if (ponder_option) {
+    if (std::optional<Move> reply = searcher.getExpectedReply(best_move)) {
+      line += " ponder " + reply->toUCI();
+    }
+  }
+  send(line);
+  if (stopped) {
+    sendLatency("stop", *stopped);
+  }
+}
+
+void UCIEngine::reportProgress() {
+  std::unique_lock<std::mutex> lock(search_mutex);
+  while (!search_cv.wait_for(lock, UCI_INFO_INTERVAL, [this] { return !searching; })) {
+    double seconds = std::chrono::duration<double>(SearchClock::now() - search_start).count();
+    lock.unlock();
+    int n_simulations = searcher.getSimulationsSoFar();
+    std::string line = "info time " + std::to_string(static_cast<int>(seconds * 1000)) +
+                       " nodes " + std::to_string(n_simulations) +
+                       " nps " + std::to_string(static_cast<int>(n_simulations / seconds));
+    if (std::optional<Move> best_candidate = searcher.getBestCandidate()) {
+      line += " pv " + best_candidate->toUCI();
+    }
+    send(line);
+    lock.lock();
+  }
+}
+
+void UCIEngine::send(const std::string& line) {
+  std::lock_guard<std::mutex> lock(out_mutex);
+  out << line << std::endl;
+}
+
+void UCIEngine::sendLatency(const std::string& command, SearchClock::time_point received) {
+  if (!debug) {
+    return;
+  }
+  double micros = std::chrono::duration<double, std::micro>(SearchClock::now() - received).count();
+  send("info string " + command + " latency " + std::to_string(static_cast<int>(micros)) + " us");
+}
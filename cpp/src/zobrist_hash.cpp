@@ -3,6 +3,7 @@
 #include "zobrist_hash.h"
 #include "constants.h"
 #include "position.h"
+#include "utils.h"
 
 std::array<std::array<std::array<unsigned long long, 64>, 6>, 2> ZobristHash::piece_keys;
 std::array<std::array<unsigned long long, 2>, 2> ZobristHash::castling_rights_keys;
@@ -66,20 +67,35 @@ ZobristHash::ZobristHash(const Position& pos) {
 
 void ZobristHash::updatePiece(Colour colour, PieceType piece_type, int square) {
   val ^= piece_keys[colour][piece_type][square];
+  flipped_val ^= piece_keys[invertColour(colour)][piece_type][square ^ 0x38];
 }
 
 void ZobristHash::updateSide(Colour colour) {
   val ^= colour_keys[colour];
+  flipped_val ^= colour_keys[invertColour(colour)];
 }
 
 void ZobristHash::updateEnpassant(int square) {
   val ^= enpassant_keys[square];
+  flipped_val ^= enpassant_keys[square ^ 0x38];
 }
 
 void ZobristHash::updateCastlingRights(Colour colour, CastlingType castling_type) {
   val ^= castling_rights_keys[colour][castling_type];
+  flipped_val ^= castling_rights_keys[invertColour(colour)][castling_type];
 }
 
 unsigned long long ZobristHash::getHash() const {
   return val;
-}
\ No newline at end of file
+}
+
+unsigned long long ZobristHash::getFlippedHash() const {
+  return flipped_val;
+}
+
+ZobristHash ZobristHash::flipped() const {
+  ZobristHash flipped_hash;
+  flipped_hash.val = flipped_val;
+  flipped_hash.flipped_val = val;
+  return flipped_hash;
+}
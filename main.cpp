@@ -8,17 +8,54 @@
 #include "zobrist_hash.h"
 #include <search.h>
 #include <net.h>
+#include <nn_cache.h>
+#include <native_net.h>
+#include <uci.h>
+#include <iostream>
+#include <memory>
+#include <string>
 
 
-int main() {
+int main(int argc, char* argv[]) {
   ZobristHash::initialiseKeys();
 
-  Position pos;
-  BlunderNet net("/home/adam/dev/blunder-bot/python/scripted_supervised_learning_model.pt");
+  // speaks UCI on stdin/stdout. --dummy searches with DummyNet so the
+  // search can be profiled without a model or any inference cost. --model
+  // path loads a different model. --threads n runs simulations on n threads
+  // and --batch k evaluates k leaves per call to the net
+  bool dummy = false;
+#ifdef BLUNDER_WITH_TORCH
+  std::string model_path = "/home/adam/dev/blunder-bot/python/scripted_supervised_learning_model.pt";
+#else
+  std::string model_path = "/home/adam/dev/blunder-bot/python/native_supervised_learning_model.bin";
+#endif
+  SearchOptions options;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--dummy") {
+      dummy = true;
+    } else if (arg == "--model" && i + 1 < argc) {
+      model_path = argv[++i];
+    } else if (arg == "--threads" && i + 1 < argc) {
+      options.n_threads = std::stoi(argv[++i]);
+    } else if (arg == "--batch" && i + 1 < argc) {
+      options.batch_size = std::stoi(argv[++i]);
+    }
+  }
+  std::unique_ptr<Net> net;
+  if (dummy) {
+    net = std::make_unique<DummyNet>();
+  } else {
+#ifdef BLUNDER_WITH_TORCH
+    net = std::make_unique<BlunderNet>(model_path);
+#else
+    net = std::make_unique<NativeBlunderNet>(model_path);
+#endif
+  }
   
-  GumbelMCTS searcher(&net, 10);
-
-  Move best_move = searcher.getBestMove(pos);
+  NNCache cache;
+  UCIEngine engine(net.get(), std::cout, &cache, options);
+  engine.loop(std::cin);
 
   return 0;
 }
\ No newline at end of file
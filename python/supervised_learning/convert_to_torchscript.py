@@ -1,15 +1,19 @@
 import torch
 
-from model import BlunderNet
+from model import BlunderNet, PackedInputBlunderNet
 
 input_channels = 66
 intermediate_channels = 64
 model_path = "/home/adam/Downloads/supervised_learning_model.pt"
+# packed models take one int64 per input plane, see BlunderNetOptions::packed_input
+packed_input = True
 
 net = BlunderNet(
   input_channels=input_channels, intermediate_channels=intermediate_channels
 )
 
 net.load_state_dict(torch.load(model_path, map_location=torch.device("cpu")))
+if packed_input:
+  net = PackedInputBlunderNet(net)
 scripted_net = torch.jit.script(net)
 scripted_net.save("/home/adam/Downloads/scripted_supervised_learning_model.pt")
\ No newline at end of file
@@ -0,0 +1,53 @@
+import struct
+import torch
+
+from model import BlunderNet
+
+# writes BlunderNet's weights in the flat format read by NativeBlunderNet
+# (cpp/src/native_net.cpp). batch norms are folded into the preceding convs
+# so the C++ side only has to do conv + bias
+
+input_channels = 66
+intermediate_channels = 64
+model_path = "/home/adam/Downloads/supervised_learning_model.pt"
+weights_path = "/home/adam/Downloads/native_supervised_learning_model.bin"
+
+MAGIC = b"BLNW"
+VERSION = 1
+
+def fold_batch_norm(conv, bn):
+  # eval-mode batch norm is an affine transform per channel so it can be
+  # absorbed into the conv's weights and bias
+  scale = bn.weight / torch.sqrt(bn.running_var + bn.eps)
+  weight = conv.weight * scale.view(-1, 1, 1, 1)
+  bias = (conv.bias - bn.running_mean) * scale + bn.bias
+  return weight, bias
+
+def write_layer(f, weight, bias):
+  # layers are stored as out_size, in_size, weights [out_size][in_size], bias [out_size]
+  weight = weight.detach().float().reshape(weight.shape[0], -1).contiguous()
+  bias = bias.detach().float().contiguous()
+  f.write(struct.pack("<ii", weight.shape[0], weight.shape[1]))
+  f.write(weight.numpy().astype("<f4").tobytes())
+  f.write(bias.numpy().astype("<f4").tobytes())
+
+net = BlunderNet(
+  input_channels=input_channels, intermediate_channels=intermediate_channels
+)
+net.load_state_dict(torch.load(model_path, map_location=torch.device("cpu")))
+net.eval()
+
+with torch.no_grad(), open(weights_path, "wb") as f:
+  f.write(MAGIC)
+  f.write(struct.pack("<ii", VERSION, len(net.main_trunk)))
+
+  write_layer(f, *fold_batch_norm(net.input_block.conv, net.input_block.bn))
+  for res_block in net.main_trunk:
+    write_layer(f, *fold_batch_norm(res_block.conv, res_block.bn))
+
+  write_layer(f, *fold_batch_norm(net.policy_head.conv, net.policy_head.bn))
+  write_layer(f, net.policy_head.fc.weight, net.policy_head.fc.bias)
+
+  write_layer(f, *fold_batch_norm(net.value_head.conv, net.value_head.bn))
+  write_layer(f, net.value_head.fc1.weight, net.value_head.fc1.bias)
+  write_layer(f, net.value_head.fc2.weight, net.value_head.fc2.bias)
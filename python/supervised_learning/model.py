@@ -82,4 +82,33 @@ class BlunderNet(nn.Module):
       out = res_block(out)
     policy = self.policy_head(out)
     value = self.value_head(out)
-    return (policy, value)
\ No newline at end of file
+    return (policy, value)
+
+class UnpackPlanes(nn.Module):
+  # expands packed input, one int64 per plane with bit i set if square i of
+  # the plane is 1, into the float planes BlunderNet is trained on. with
+  # channels_last the planes come out in the layout oneDNN convolutions
+  # prefer, as the engine can't lay out planes the model makes itself
+  def __init__(self, channels_last=True):
+    super().__init__()
+    self.register_buffer("shifts", torch.arange(64, dtype=torch.int64), persistent=False)
+    self.channels_last = channels_last
+
+  def forward(self, x):
+    bits = (x.unsqueeze(-1) >> self.shifts) & 1
+    planes = bits.view(x.shape[0], x.shape[1], 8, 8).float()
+    if self.channels_last:
+      planes = planes.contiguous(memory_format=torch.channels_last)
+    return planes
+
+class PackedInputBlunderNet(nn.Module):
+  # wraps a trained BlunderNet so it takes (batch, 66) int64 packed planes.
+  # the C++ side can then pass bitboards straight through, which is 0.5KB
+  # per position instead of 17KB of floats
+  def __init__(self, net, channels_last=True):
+    super().__init__()
+    self.unpack = UnpackPlanes(channels_last)
+    self.net = net
+
+  def forward(self, x):
+    return self.net(self.unpack(x))
@@ -0,0 +1,116 @@
+import time
+import torch
+from torch.ao.quantization import get_default_qconfig_mapping
+from torch.ao.quantization.quantize_fx import prepare_fx, convert_fx
+from torch.utils.data import DataLoader
+
+from data import LichessDataset
+from model import BlunderNet, PackedInputBlunderNet
+
+# produces a statically quantized (int8 weights and activations) TorchScript
+# model for CPU inference, calibrating the activation ranges on sample
+# positions. also writes a report comparing it against the fp32 model so we
+# know what accuracy we're trading for speed. load the result in C++ with
+# BlunderNetOptions::quantized = true
+
+input_channels = 66
+intermediate_channels = 64
+model_path = "/home/adam/Downloads/supervised_learning_model.pt"
+fp32_model_path = "/home/adam/Downloads/scripted_supervised_learning_model.pt"
+quantized_model_path = "/home/adam/Downloads/quantized_supervised_learning_model.pt"
+report_path = "/home/adam/Downloads/quantization_report.txt"
+
+dataset_root_path = "/home/adam/Downloads/lichess_elite/"
+# calibrate and evaluate on different months so the report isn't measured on
+# the calibration positions
+calibration_pgns = [dataset_root_path + "lichess_elite_2020-05.pgn"]
+evaluation_pgns = [dataset_root_path + "lichess_elite_2020-06.pgn"]
+
+batch_size = 256
+n_calibration_batches = 16
+n_evaluation_batches = 16
+latency_batch_sizes = [1, 8, 64]
+n_latency_runs = 200
+
+# packed models take one int64 per input plane, see BlunderNetOptions::packed_input
+packed_input = True
+
+# fbgemm is the x86 backend, use qnnpack for ARM hosts
+engine = "fbgemm"
+torch.backends.quantized.engine = engine
+
+def load_batches(pgn_paths, n_batches):
+  batches = []
+  for i, (x, _, _) in enumerate(DataLoader(LichessDataset(pgn_paths), batch_size=batch_size)):
+    if i >= n_batches:
+      break
+    batches.append(x)
+  return batches
+
+def measure_latency(model, batch):
+  with torch.inference_mode():
+    # warm up so we don't time the TorchScript profiling runs
+    for _ in range(10):
+      model(batch)
+    start = time.perf_counter()
+    for _ in range(n_latency_runs):
+      model(batch)
+    end = time.perf_counter()
+  return (end - start) / n_latency_runs
+
+net = BlunderNet(
+  input_channels=input_channels, intermediate_channels=intermediate_channels
+)
+net.load_state_dict(torch.load(model_path, map_location=torch.device("cpu")))
+net.eval()
+
+print("calibrating")
+example_inputs = (torch.zeros(1, input_channels, 8, 8),)
+prepared_net = prepare_fx(net, get_default_qconfig_mapping(engine), example_inputs)
+with torch.no_grad():
+  for x in load_batches(calibration_pgns, n_calibration_batches):
+    prepared_net(x)
+quantized_net = convert_fx(prepared_net)
+
+# the report below feeds float planes so compare the unwrapped nets, but save
+# the versions the engine will load
+scripted_quantized_net = torch.jit.script(quantized_net)
+scripted_fp32_net = torch.jit.script(net)
+if packed_input:
+  torch.jit.script(PackedInputBlunderNet(quantized_net)).save(quantized_model_path)
+  torch.jit.script(PackedInputBlunderNet(net)).save(fp32_model_path)
+else:
+  scripted_quantized_net.save(quantized_model_path)
+  scripted_fp32_net.save(fp32_model_path)
+
+print("evaluating")
+n_positions = 0
+n_top1_agree = 0
+value_squared_error = 0
+with torch.inference_mode():
+  for x in load_batches(evaluation_pgns, n_evaluation_batches):
+    fp32_policy, fp32_value = scripted_fp32_net(x)
+    int8_policy, int8_value = scripted_quantized_net(x)
+    n_top1_agree += (fp32_policy.argmax(dim=1) == int8_policy.argmax(dim=1)).sum().item()
+    value_squared_error += ((fp32_value - int8_value) ** 2).sum().item()
+    n_positions += x.shape[0]
+
+report = [
+  f"quantization engine: {engine}",
+  f"positions evaluated: {n_positions}",
+  f"policy top-1 agreement: {100 * n_top1_agree / n_positions:.2f}%",
+  f"value MSE vs fp32: {value_squared_error / n_positions:.6f}",
+  "",
+  "batch size | fp32 ms | int8 ms | speedup",
+]
+for latency_batch_size in latency_batch_sizes:
+  batch = torch.rand(latency_batch_size, input_channels, 8, 8).round()
+  fp32_latency = measure_latency(scripted_fp32_net, batch)
+  int8_latency = measure_latency(scripted_quantized_net, batch)
+  report.append(
+    f"{latency_batch_size:>10} | {fp32_latency * 1000:>7.3f} | {int8_latency * 1000:>7.3f} | {fp32_latency / int8_latency:.2f}x"
+  )
+
+print("\n".join(report))
+with open(report_path, "w") as f:
+  f.write("\n".join(report) + "\n")
@@ -0,0 +1,65 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstdint>
+#include <string>
+
+#include "arena.h"
+
+TEST_CASE("test Arena create() and createArray()", "[arena]") {
+  Arena arena(1024);
+  int* i = arena.create<int>(7);
+  double* d = arena.create<double>(2.5);
+  std::span<uint16_t> arr = arena.createArray<uint16_t>(10);
+  REQUIRE(*i == 7);
+  REQUIRE(*d == 2.5);
+  REQUIRE(reinterpret_cast<uintptr_t>(d) % alignof(double) == 0);
+  REQUIRE(arr.size() == 10);
+  for (uint16_t val : arr) {
+    REQUIRE(val == 0);
+  }
+  REQUIRE(arena.bytesUsed() == sizeof(int) + sizeof(double) + 10 * sizeof(uint16_t));
+  REQUIRE(arena.bytesReserved() == 1024);
+}
+
+TEST_CASE("test Arena grows and reuses slabs", "[arena]") {
+  Arena arena(64);
+  for (int i = 0; i < 32; i++) {
+    arena.create<uint64_t>(i);
+  }
+  // allocations larger than a slab get a slab of their own
+  std::span<char> big = arena.createArray<char>(1000);
+  REQUIRE(big.size() == 1000);
+  size_t reserved = arena.bytesReserved();
+  REQUIRE(reserved >= 32 * sizeof(uint64_t) + 1000);
+
+  arena.release();
+  REQUIRE(arena.bytesUsed() == 0);
+  for (int i = 0; i < 32; i++) {
+    arena.create<uint64_t>(i);
+  }
+  REQUIRE(arena.bytesReserved() == reserved);
+}
+
+TEST_CASE("test Arena release() runs destructors", "[arena]") {
+  struct Counted {
+    Counted(int& n_destroyed) : n_destroyed(n_destroyed) {}
+    ~Counted() { n_destroyed++; }
+    int& n_destroyed;
+  };
+
+  int n_destroyed = 0;
+  {
+    Arena arena;
+    for (int i = 0; i < 5; i++) {
+      arena.create<Counted>(n_destroyed);
+    }
+    // non-trivial members are cleaned up too
+    arena.create<std::string>(100, 'x');
+    arena.release();
+    REQUIRE(n_destroyed == 5);
+
+    arena.create<Counted>(n_destroyed);
+  }
+  // and the arena releases whatever is left when it's destroyed
+  REQUIRE(n_destroyed == 6);
+}
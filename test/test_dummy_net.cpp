@@ -0,0 +1,66 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_approx.hpp>
+
+#include "net.h"
+#include "position.h"
+#include "useful_fens.h"
+
+TEST_CASE("test DummyNet start position is level", "[dummy_net]") {
+  DummyNet net;
+  Position pos;
+  std::vector<std::pair<Move, float>> policy;
+  REQUIRE(net.getEvaluation(pos, policy) == Catch::Approx(0));
+  REQUIRE(policy.size() == 20);
+}
+
+TEST_CASE("test DummyNet value is from side to move's perspective", "[dummy_net]") {
+  DummyNet net;
+  // white is a queen up
+  Position white_to_move("4k3/8/8/8/8/8/8/3QK3 w - - 0 1");
+  Position black_to_move("4k3/8/8/8/8/8/8/3QK3 b - - 0 1");
+  std::vector<std::pair<Move, float>> policy;
+  double white_value = net.getEvaluation(white_to_move, policy);
+  policy.clear();
+  double black_value = net.getEvaluation(black_to_move, policy);
+  REQUIRE(white_value > 0.5);
+  REQUIRE(black_value == Catch::Approx(-white_value));
+}
+
+TEST_CASE("test DummyNet priors", "[dummy_net]") {
+  Position pos(tricky_position);
+  Move queen_takes_pawn(21, 23, MoveType::Capture);
+  Move quiet_king_move(4, 3, MoveType::Quiet);
+
+  DummyNet uniform_net(DummyPriors::Uniform);
+  std::vector<std::pair<Move, float>> uniform_policy;
+  uniform_net.getEvaluation(pos, uniform_policy);
+  float total = 0;
+  for (const auto& [move, prior] : uniform_policy) {
+    REQUIRE(prior == Catch::Approx(1.0 / uniform_policy.size()));
+    total += prior;
+  }
+  REQUIRE(total == Catch::Approx(1));
+
+  DummyNet biased_net(DummyPriors::CaptureBiased);
+  std::vector<std::pair<Move, float>> biased_policy;
+  biased_net.getEvaluation(pos, biased_policy);
+  REQUIRE(biased_policy.size() == uniform_policy.size());
+  float capture_prior = 0;
+  float quiet_prior = 0;
+  total = 0;
+  for (const auto& [move, prior] : biased_policy) {
+    if (move == queen_takes_pawn) {
+      capture_prior = prior;
+    } else if (move == quiet_king_move) {
+      quiet_prior = prior;
+    }
+    total += prior;
+  }
+  REQUIRE(total == Catch::Approx(1));
+  REQUIRE(capture_prior == Catch::Approx(2 * quiet_prior));
+
+  // same input always gives the same output
+  std::vector<std::pair<Move, float>> repeat_policy;
+  biased_net.getEvaluation(pos, repeat_policy);
+  REQUIRE(repeat_policy == biased_policy);
+}
@@ -0,0 +1,54 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <vector>
+
+#include "encoding.h"
+#include "position.h"
+#include "zobrist_hash.h"
+
+TEST_CASE("test encodeInputPlanes() on start position", "[encoding]") {
+  ZobristHash::initialiseKeys();
+  Position pos;
+  std::vector<float> planes(N_INPUT_PLANES * N_SQUARES);
+  encodeInputPlanes(pos, planes.data());
+
+  // white pawns fill the 2nd rank of the first plane
+  for (int square = 0; square < N_SQUARES; square++) {
+    REQUIRE(planes[square] == (square >= 8 && square < 16 ? 1 : 0));
+  }
+  // no history yet so the history planes are empty
+  for (int i = N_PIECE_PLANES * N_SQUARES; i < N_PIECE_PLANES * (POS_HISTORY_LEN + 1) * N_SQUARES; i++) {
+    REQUIRE(planes[i] == 0);
+  }
+  // castling, side to move and edge planes are all 1s
+  for (int i = N_PIECE_PLANES * (POS_HISTORY_LEN + 1) * N_SQUARES; i < N_INPUT_PLANES * N_SQUARES; i++) {
+    REQUIRE(planes[i] == 1);
+  }
+}
+
+TEST_CASE("test policyIndexToMove() flips moves for black", "[encoding]") {
+  Position white_pos;
+  Move white_move = policyIndexToMove((12 * 64) + 28, white_pos);
+  REQUIRE(white_move == Move(12, 28, MoveType::Quiet));
+
+  Position black_pos("rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1");
+  Move black_move = policyIndexToMove((12 * 64) + 28, black_pos);
+  REQUIRE(black_move == Move(52, 36, MoveType::Quiet));
+}
+
+TEST_CASE("test encodePackedInput() matches unpacked planes", "[encoding]") {
+  Position pos(tricky_position);
+  Position child = pos.applyMove(Move(14, 30, MoveType::Quiet));
+  BoardBits packed_planes[N_INPUT_PLANES];
+  encodePackedInput(child, packed_planes);
+  std::vector<float> planes(N_INPUT_PLANES * N_SQUARES);
+  encodeInputPlanes(child, planes.data());
+
+  for (int plane = 0; plane < N_INPUT_PLANES; plane++) {
+    for (int square = 0; square < N_SQUARES; square++) {
+      REQUIRE(planes[(plane * N_SQUARES) + square] == ((packed_planes[plane] >> square) & 1));
+    }
+  }
+  // edge plane has every bit set
+  REQUIRE(packed_planes[N_INPUT_PLANES - 1] == ALL_SQUARES);
+}
@@ -0,0 +1,66 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <vector>
+
+#include "evaluation_queue.h"
+#include "position.h"
+#include "zobrist_hash.h"
+
+DetachedCoroutine evaluateTwice(EvaluationQueue& queue, const Position& pos, std::vector<double>& values) {
+  BoardBits packed_planes[N_INPUT_PLANES] = {};
+  BatchEntry& first = co_await queue.evaluate(pos, packed_planes);
+  values.push_back(first.value);
+  BatchEntry& second = co_await queue.evaluate(pos, packed_planes);
+  values.push_back(second.value);
+}
+
+DetachedCoroutine retryOnce(EvaluationQueue& queue, int& n_resumed) {
+  co_await queue.nextBatch();
+  n_resumed++;
+}
+
+TEST_CASE("test EvaluationQueue resumes coroutines once their batch is evaluated", "[evaluation_queue]") {
+  ZobristHash::initialiseKeys();
+  Position pos;
+  EvaluationQueue queue;
+  std::vector<double> values;
+  int n_batches = 0;
+  auto evaluate_batch = [&n_batches](std::span<BatchEntry> batch) {
+    n_batches++;
+    for (BatchEntry& entry : batch) {
+      entry.value = n_batches;
+    }
+  };
+
+  // both coroutines run until they wait for the net
+  evaluateTwice(queue, pos, values);
+  evaluateTwice(queue, pos, values);
+  REQUIRE(queue.size() == 2);
+  REQUIRE(queue.inFlight() == 2);
+  REQUIRE(values.empty());
+
+  // their second evaluations wait for the next batch
+  queue.runBatch(evaluate_batch);
+  REQUIRE(values == std::vector<double>{1, 1});
+  REQUIRE(queue.size() == 2);
+
+  queue.runBatch(evaluate_batch);
+  REQUIRE(values == std::vector<double>{1, 1, 2, 2});
+  REQUIRE(queue.empty());
+}
+
+TEST_CASE("test EvaluationQueue resumes retries after the batch", "[evaluation_queue]") {
+  EvaluationQueue queue;
+  int n_resumed = 0;
+  retryOnce(queue, n_resumed);
+  REQUIRE(!queue.empty());
+  REQUIRE(queue.size() == 0);
+  REQUIRE(queue.inFlight() == 1);
+
+  bool evaluated = false;
+  queue.runBatch([&evaluated](std::span<BatchEntry>) { evaluated = true; });
+  // nothing was waiting for the net so it isn't called
+  REQUIRE(!evaluated);
+  REQUIRE(n_resumed == 1);
+  REQUIRE(queue.empty());
+}
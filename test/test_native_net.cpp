@@ -0,0 +1,175 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_approx.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "encoding.h"
+#include "native_net.h"
+#include "position.h"
+#include "useful_fens.h"
+#include "zobrist_hash.h"
+
+// a smaller BlunderNet than the real one so the reference below stays quick.
+// 10 channels isn't a multiple of either SIMD kernel's tile height, so the
+// rows left over after the tiles are covered too
+constexpr int TEST_CHANNELS = 10;
+constexpr int TEST_RES_BLOCKS = 2;
+constexpr int TEST_VALUE_HIDDEN = 32;
+
+NativeLayer makeRandomLayer(std::mt19937& rng, int out_size, int in_size) {
+  // scaled so activations stay around 1 however many inputs a layer has
+  std::normal_distribution<float> dist(0, 1 / std::sqrt(static_cast<float>(in_size)));
+  NativeLayer layer{out_size, in_size, std::vector<float>(out_size * in_size), std::vector<float>(out_size)};
+  std::generate(layer.weights.begin(), layer.weights.end(), [&] { return dist(rng); });
+  std::generate(layer.bias.begin(), layer.bias.end(), [&] { return dist(rng); });
+  return layer;
+}
+
+// the layers in the order export_native_weights.py writes them: input conv,
+// residual convs, policy conv and fc, value conv, fc1 and fc2
+std::vector<NativeLayer> makeRandomLayers() {
+  std::mt19937 rng(1);
+  std::vector<NativeLayer> layers;
+  layers.push_back(makeRandomLayer(rng, TEST_CHANNELS, N_INPUT_PLANES * 9));
+  for (int i = 0; i < TEST_RES_BLOCKS; i++) {
+    layers.push_back(makeRandomLayer(rng, TEST_CHANNELS, TEST_CHANNELS * 9));
+  }
+  layers.push_back(makeRandomLayer(rng, 2, TEST_CHANNELS));
+  layers.push_back(makeRandomLayer(rng, N_POLICY_OUTPUTS, 2 * N_SQUARES));
+  layers.push_back(makeRandomLayer(rng, 1, TEST_CHANNELS));
+  layers.push_back(makeRandomLayer(rng, TEST_VALUE_HIDDEN, N_SQUARES));
+  layers.push_back(makeRandomLayer(rng, 1, TEST_VALUE_HIDDEN));
+  return layers;
+}
+
+void writeNativeWeights(const std::string& path, const std::vector<NativeLayer>& layers) {
+  std::ofstream file(path, std::ios::binary);
+  int32_t header[2] = {1, TEST_RES_BLOCKS};
+  file.write("BLNW", 4);
+  file.write(reinterpret_cast<const char*>(header), sizeof(header));
+  for (const NativeLayer& layer : layers) {
+    int32_t sizes[2] = {layer.out_size, layer.in_size};
+    file.write(reinterpret_cast<const char*>(sizes), sizeof(sizes));
+    file.write(reinterpret_cast<const char*>(layer.weights.data()), layer.weights.size() * sizeof(float));
+    file.write(reinterpret_cast<const char*>(layer.bias.data()), layer.bias.size() * sizeof(float));
+  }
+}
+
+// a size x size convolution with zero padding, one output at a time
+std::vector<double> referenceConv(const NativeLayer& layer, const std::vector<double>& input, int size) {
+  int in_channels = layer.in_size / (size * size);
+  std::vector<double> output(layer.out_size * N_SQUARES);
+  for (int out = 0; out < layer.out_size; out++) {
+    for (int rank = 0; rank < 8; rank++) {
+      for (int file = 0; file < 8; file++) {
+        double sum = layer.bias[out];
+        for (int in = 0; in < in_channels; in++) {
+          for (int ky = 0; ky < size; ky++) {
+            for (int kx = 0; kx < size; kx++) {
+              int src_rank = rank + ky - (size / 2);
+              int src_file = file + kx - (size / 2);
+              if (src_rank < 0 || src_rank > 7 || src_file < 0 || src_file > 7) {
+                continue;
+              }
+              double weight = layer.weights[(out * layer.in_size) + (((in * size) + ky) * size) + kx];
+              sum += weight * input[(in * N_SQUARES) + (src_rank * 8) + src_file];
+            }
+          }
+        }
+        output[(out * N_SQUARES) + (rank * 8) + file] = sum;
+      }
+    }
+  }
+  return output;
+}
+
+std::vector<double> referenceFC(const NativeLayer& layer, const std::vector<double>& input) {
+  std::vector<double> output(layer.out_size);
+  for (int out = 0; out < layer.out_size; out++) {
+    output[out] = layer.bias[out];
+    for (int in = 0; in < layer.in_size; in++) {
+      output[out] += layer.weights[(out * layer.in_size) + in] * input[in];
+    }
+  }
+  return output;
+}
+
+void referenceRelu(std::vector<double>& values) {
+  for (double& value : values) {
+    value = std::max(value, 0.0);
+  }
+}
+
+// BlunderNet's forward pass as in python/supervised_learning/model.py with
+// the batch norms already folded. returns the value and writes the softmaxed
+// policy to policy
+double referenceEvaluation(const std::vector<NativeLayer>& layers, const Position& pos, std::vector<double>& policy) {
+  std::vector<float> planes(N_INPUT_PLANES * N_SQUARES);
+  encodeInputPlanes(pos, planes.data());
+  std::vector<double> trunk = referenceConv(layers[0], std::vector<double>(planes.begin(), planes.end()), 3);
+  referenceRelu(trunk);
+  for (int i = 1; i <= TEST_RES_BLOCKS; i++) {
+    std::vector<double> out = referenceConv(layers[i], trunk, 3);
+    referenceRelu(out);
+    for (size_t j = 0; j < out.size(); j++) {
+      trunk[j] += out[j];
+    }
+  }
+
+  std::vector<double> policy_hidden = referenceConv(layers[TEST_RES_BLOCKS + 1], trunk, 1);
+  referenceRelu(policy_hidden);
+  policy = referenceFC(layers[TEST_RES_BLOCKS + 2], policy_hidden);
+  double max_logit = *std::max_element(policy.begin(), policy.end());
+  double total = 0;
+  for (double& logit : policy) {
+    logit = std::exp(logit - max_logit);
+    total += logit;
+  }
+  for (double& prob : policy) {
+    prob /= total;
+  }
+
+  std::vector<double> value_hidden = referenceConv(layers[TEST_RES_BLOCKS + 3], trunk, 1);
+  referenceRelu(value_hidden);
+  std::vector<double> value_fc1 = referenceFC(layers[TEST_RES_BLOCKS + 4], value_hidden);
+  referenceRelu(value_fc1);
+  double value = std::tanh(referenceFC(layers[TEST_RES_BLOCKS + 5], value_fc1)[0]);
+  return (pos.getSideToMove() == Colour::Black) ? -value : value;
+}
+
+TEST_CASE("test NativeBlunderNet matches a direct implementation of BlunderNet", "[native_net]") {
+  ZobristHash::initialiseKeys();
+  std::vector<NativeLayer> layers = makeRandomLayers();
+  std::string path = (std::filesystem::temp_directory_path() / "test_native_net_weights.bin").string();
+  writeNativeWeights(path, layers);
+
+  // black to move covers the flipped board, and e2e4 gives it a history
+  Position start(start_position);
+  Position after_e4 = start.applyMove(Move(12, 28, MoveType::Quiet));
+  Position tricky(tricky_position);
+  for (bool simd_kernels : {true, false}) {
+    NativeBlunderNet net(path, simd_kernels);
+    for (const Position* pos : {&start, &after_e4, &tricky}) {
+      std::vector<double> expected_policy;
+      double expected_value = referenceEvaluation(layers, *pos, expected_policy);
+      std::vector<std::pair<Move, float>> policy;
+      double value = net.getEvaluation(*pos, policy);
+      REQUIRE(value == Catch::Approx(expected_value).margin(1e-4));
+      REQUIRE(policy.size() == N_POLICY_OUTPUTS);
+      for (int i = 0; i < N_POLICY_OUTPUTS; i++) {
+        REQUIRE(policy[i].second == Catch::Approx(expected_policy[i]).epsilon(1e-4));
+      }
+    }
+  }
+  if (!NativeBlunderNet::hasSIMDKernels()) {
+    WARN("built without AVX2 or AVX-512, only the plain loops were checked");
+  }
+  std::filesystem::remove(path);
+}
@@ -0,0 +1,41 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "nn_cache.h"
+#include "position.h"
+#include "zobrist_hash.h"
+
+TEST_CASE("test NNCache lookup after insert", "[nn_cache]") {
+  NNCache cache(16);
+  std::vector<std::pair<Move, float>> priors = {
+    {Move(12, 28, MoveType::Quiet), 0.75},
+    {Move(52, 60, MoveType::Capture, PieceType::Queen), 0.25},
+  };
+  cache.insert(42, 0.5, priors);
+
+  float value;
+  std::vector<std::pair<Move, float>> cached_priors;
+  REQUIRE(cache.lookup(42, value, cached_priors));
+  REQUIRE(value == 0.5);
+  REQUIRE(cached_priors == priors);
+
+  // same slot, different key
+  REQUIRE_FALSE(cache.lookup(42 + 16, value, cached_priors));
+  cache.clear();
+  REQUIRE_FALSE(cache.lookup(42, value, cached_priors));
+}
+
+TEST_CASE("test historyHash() depends on history", "[nn_cache]") {
+  ZobristHash::initialiseKeys();
+  Position start;
+  // reach the same board via a different move order
+  Position a1 = start.applyMove(Move(6, 21, MoveType::Quiet));
+  Position a2 = a1.applyMove(Move(62, 45, MoveType::Quiet));
+  Position a3 = a2.applyMove(Move(1, 18, MoveType::Quiet));
+
+  Position b1 = start.applyMove(Move(1, 18, MoveType::Quiet));
+  Position b2 = b1.applyMove(Move(62, 45, MoveType::Quiet));
+  Position b3 = b2.applyMove(Move(6, 21, MoveType::Quiet));
+
+  REQUIRE(a3.getHash() == b3.getHash());
+  REQUIRE(historyHash(a3) != historyHash(b3));
+}
@@ -192,11 +192,55 @@ TEST_CASE("test flipped Position", "[position]") {
           all_pieces.getBit(G2) && all_pieces.getBit(C8) &&
           all_pieces.getBit(A7) && all_pieces.getBit(B7)));
 
-  REQUIRE(flipped_pos.getPieceBitBoard(Colour::White, PieceType::Bishop)
+  // flipping swaps colours so white's bishop becomes black's
+  REQUIRE(flipped_pos.getPieceBitBoard(Colour::Black, PieceType::Bishop)
               .getHighestSetBit() == C8);
+  REQUIRE(flipped_pos.getPieceBitBoard(Colour::White, PieceType::King)
+              .getHighestSetBit() == E1);
+  REQUIRE(flipped_pos.getSideToMove() == Colour::Black);
 
   REQUIRE(flipped_pos.canCastle(Colour::White, CastlingType::Kingside));
   REQUIRE_FALSE(flipped_pos.canCastle(Colour::Black, CastlingType::Kingside));
 }
 
-// TODO: add more Position tests
\ No newline at end of file
+TEST_CASE("test flipped hash matches hash of flipped Position", "[position]") {
+  Position pos("4k2r/6pp/8/8/8/8/PP6/2B1K3 w k - 0 1");
+  Position mirrored_pos("2b1k3/pp6/8/8/8/8/6PP/4K2R b K - 0 1");
+  REQUIRE(pos.getFlippedHash() == mirrored_pos.getHash());
+  REQUIRE(pos.flip().getHash() == mirrored_pos.getHash());
+  REQUIRE(pos.flip().getFlippedHash() == pos.getHash());
+
+  // flipped hash stays in sync as moves are made
+  Position after_push = pos.applyMove(Move(9, 25, MoveType::Quiet));
+  Position mirrored_after_push("2b1k3/p7/8/1p6/8/8/6PP/4K2R w K b6 0 1");
+  REQUIRE(after_push.getFlippedHash() == mirrored_after_push.getHash());
+
+  Position flipped_pos;
+  after_push.flipInto(flipped_pos);
+  REQUIRE(flipped_pos.getHash() == mirrored_after_push.getHash());
+  REQUIRE(flipped_pos.getEnpassantBitBoard().getBit(B6));
+  REQUIRE_FALSE(flipped_pos.isDrawByRepetition());
+}
+
+// TODO: add more Position tests
+TEST_CASE("test Move pack() and unpack() round trip", "[position]") {
+  std::vector<Move> moves = {
+    Move(12, 28, MoveType::Quiet),
+    Move(27, 36, MoveType::Capture),
+    Move(36, 43, MoveType::EnPassantCapture),
+    Move(4, 6, MoveType::KingsideCastle),
+    Move(60, 58, MoveType::QueensideCastle),
+    Move(52, 60, MoveType::Quiet, PieceType::Queen),
+    Move(9, 0, MoveType::Capture, PieceType::Knight),
+  };
+  for (const Move& move : moves) {
+    REQUIRE(Move::unpack(move.pack()) == move);
+  }
+}
+
+TEST_CASE("test Move toUCI()", "[position]") {
+  REQUIRE(Move(12, 28, MoveType::Quiet).toUCI() == "e2e4");
+  REQUIRE(Move(4, 6, MoveType::KingsideCastle).toUCI() == "e1g1");
+  REQUIRE(Move(52, 60, MoveType::Quiet, PieceType::Queen).toUCI() == "e7e8q");
+  REQUIRE(Move(9, 0, MoveType::Capture, PieceType::Knight).toUCI() == "b2a1n");
+}
@@ -0,0 +1,44 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <thread>
+
+#include "reclaimer.h"
+
+TEST_CASE("test Reclaimer frees arenas on its own thread", "[reclaimer]") {
+  struct RecordsThread {
+    RecordsThread(std::thread::id& freed_on) : freed_on(freed_on) {}
+    ~RecordsThread() { freed_on = std::this_thread::get_id(); }
+    std::thread::id& freed_on;
+  };
+
+  std::thread::id freed_on;
+  Reclaimer reclaimer;
+  std::unique_ptr<Arena> arena = std::make_unique<Arena>(1024);
+  arena->create<RecordsThread>(freed_on);
+  reclaimer.reclaim(std::move(arena));
+  reclaimer.wait();
+
+  REQUIRE(freed_on != std::thread::id());
+  REQUIRE(freed_on != std::this_thread::get_id());
+  REQUIRE(reclaimer.getBytesReclaimed() == 1024);
+  REQUIRE(reclaimer.getReclaimSeconds() >= 0);
+}
+
+TEST_CASE("test Reclaimer frees queued arenas before stopping", "[reclaimer]") {
+  int n_destroyed = 0;
+  struct Counted {
+    Counted(int& n_destroyed) : n_destroyed(n_destroyed) {}
+    ~Counted() { n_destroyed++; }
+    int& n_destroyed;
+  };
+
+  {
+    Reclaimer reclaimer;
+    for (int i = 0; i < 10; i++) {
+      std::unique_ptr<Arena> arena = std::make_unique<Arena>(256);
+      arena->create<Counted>(n_destroyed);
+      reclaimer.reclaim(std::move(arena));
+    }
+  }
+  REQUIRE(n_destroyed == 10);
+}
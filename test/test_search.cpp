@@ -0,0 +1,406 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <optional>
+#include <string>
+#include <span>
+#include <thread>
+
+#include "encoding.h"
+#include "move_generator.h"
+#include "net.h"
+#include "nn_cache.h"
+#include "search.h"
+#include "zobrist_hash.h"
+
+// a net whose policy covers none of the legal moves, as BlunderNet's policy
+// head doesn't cover castling or en passant
+class NoPolicyNet : public Net {
+  public:
+    using Net::getEvaluation;
+    double getEvaluation(const Position&, const BoardBits*, std::vector<std::pair<Move, float>>&) override { return 0; }
+    bool isThreadSafe() const override { return true; }
+};
+
+// DummyNet counting the evaluations whose input differs from encoding pos
+// and its parents from scratch
+class HistoryCheckingNet : public DummyNet {
+  public:
+    using Net::getEvaluation;
+    double getEvaluation(const Position& pos, const BoardBits* packed_planes, std::vector<std::pair<Move, float>>& policy) override {
+      BoardBits expected_planes[N_INPUT_PLANES];
+      encodePackedInput(pos, expected_planes);
+      if (!std::equal(expected_planes, expected_planes + N_INPUT_PLANES, packed_planes)) {
+        n_mismatches++;
+      }
+      return DummyNet::getEvaluation(pos, packed_planes, policy);
+    }
+    int n_mismatches = 0;
+};
+
+// DummyNet putting almost all of its policy on one quiet move. captures
+// get less than MIN_POLICY_PROB and everything else even less
+class PeakedNet : public DummyNet {
+  public:
+    using Net::getEvaluation;
+    double getEvaluation(const Position& pos, const BoardBits* packed_planes, std::vector<std::pair<Move, float>>& policy) override {
+      double value = DummyNet::getEvaluation(pos, packed_planes, policy);
+      bool peaked = false;
+      for (auto& move_prior : policy) {
+        if (move_prior.first.move_type == MoveType::Quiet && !peaked) {
+          move_prior.second = 1;
+          peaked = true;
+        } else if (move_prior.first.move_type == MoveType::Capture) {
+          move_prior.second = 1e-4;
+        } else {
+          move_prior.second = 1e-6;
+        }
+      }
+      return value;
+    }
+};
+
+// DummyNet taking about as long as BlunderNet does on a CPU
+class SlowNet : public DummyNet {
+  public:
+    using Net::getEvaluation;
+    double getEvaluation(const Position& pos, const BoardBits* packed_planes, std::vector<std::pair<Move, float>>& policy) override {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      return DummyNet::getEvaluation(pos, packed_planes, policy);
+    }
+};
+
+// DummyNet recording the largest batch it was given
+class BatchRecordingNet : public DummyNet {
+  public:
+    void getEvaluations(std::span<BatchEntry> batch) override {
+      largest_batch = std::max<int>(largest_batch, batch.size());
+      DummyNet::getEvaluations(batch);
+    }
+    int largest_batch = 0;
+};
+
+bool isLegal(const Position& pos, const Move& move) {
+  MoveGenerator move_gen;
+  MoveVec legal_moves = move_gen.generateMoves(pos);
+  return std::find(legal_moves.begin(), legal_moves.end(), move) != legal_moves.end();
+}
+
+// the search played a legal move and every simulation went through one of
+// the root's children
+void requireSoundSearch(const GumbelMCTS& searcher, const Position& pos, const Move& move) {
+  REQUIRE(isLegal(pos, move));
+  REQUIRE(searcher.getStats().n_simulations > 0);
+  REQUIRE(searcher.getStats().total_visits == searcher.getStats().n_simulations);
+}
+
+TEST_CASE("test GumbelMCTS encodes the history of the positions it evaluates", "[search]") {
+  ZobristHash::initialiseKeys();
+  HistoryCheckingNet net;
+  GumbelMCTS searcher(&net, 200);
+  // the root's history comes from the game, the rest from the search path
+  std::deque<Position> game;
+  game.emplace_back();
+  MoveGenerator move_gen;
+  for (int i = 0; i < 3; i++) {
+    game.push_back(game.back().applyMove(move_gen.generateMoves(game.back())[0]));
+  }
+  requireSoundSearch(searcher, game.back(), searcher.getBestMove(game.back()));
+  REQUIRE(searcher.getStats().nn_evaluations > 0);
+  REQUIRE(net.n_mismatches == 0);
+}
+
+TEST_CASE("test GumbelMCTS only generates moves for uncached positions", "[search]") {
+  ZobristHash::initialiseKeys();
+  DummyNet net;
+  NNCache cache;
+  GumbelMCTS searcher(&net, 200, &cache);
+  Position start;
+  requireSoundSearch(searcher, start, searcher.getBestMove(start));
+  int uncached_move_generations = searcher.getStats().move_generations;
+
+  // the same search again, now with every position it expands cached
+  searcher.resetTree();
+  requireSoundSearch(searcher, start, searcher.getBestMove(start));
+  const SearchStats& stats = searcher.getStats();
+  REQUIRE(stats.cache_hits > 0);
+  REQUIRE(stats.move_generations < uncached_move_generations);
+}
+
+TEST_CASE("test GumbelMCTS searches moves the policy doesn't cover", "[search]") {
+  ZobristHash::initialiseKeys();
+  NoPolicyNet net;
+  GumbelMCTS searcher(&net, 50);
+  // capturing d5 en passant is white's only legal move
+  Position pos("K7/8/4p3/2bpP3/8/8/1r6/7k w - d6 0 1");
+  Move best_move = searcher.getBestMove(pos);
+  REQUIRE(best_move.toUCI() == "e5d6");
+  REQUIRE(best_move.move_type == MoveType::EnPassantCapture);
+
+  // every legal move gets a child even though the net gave no priors
+  Position start;
+  MoveGenerator move_gen;
+  best_move = searcher.getBestMove(start);
+  REQUIRE(isLegal(start, best_move));
+  REQUIRE(searcher.getStats().n_nodes > static_cast<int>(move_gen.generateMoves(start).size()));
+}
+
+TEST_CASE("test GumbelMCTS prunes unlikely moves below the root", "[search]") {
+  ZobristHash::initialiseKeys();
+  PeakedNet net;
+  GumbelMCTS searcher(&net, 200);
+  // the root keeps every move, so taking the queen is found even though the
+  // net thinks it is too unlikely to search anywhere else
+  Position pos("q6k/R7/8/8/8/8/6PP/7K w - - 0 1");
+  Move best_move = searcher.getBestMove(pos);
+  requireSoundSearch(searcher, pos, best_move);
+  REQUIRE(best_move.move_type == MoveType::Capture);
+  REQUIRE(searcher.getStats().n_pruned > 0);
+}
+
+TEST_CASE("test GumbelMCTS reuses the subtree of the move played", "[search]") {
+  ZobristHash::initialiseKeys();
+  DummyNet net;
+  GumbelMCTS searcher(&net, 200);
+  // each search plays its best move and the next one carries on from it
+  std::deque<Position> game;
+  game.emplace_back();
+  Move move = searcher.getBestMove(game.back());
+  for (int i = 0; i < 2; i++) {
+    game.push_back(game.back().applyMove(move));
+    move = searcher.getBestMove(game.back());
+    REQUIRE(isLegal(game.back(), move));
+    REQUIRE(searcher.getStats().reused_visits > 0);
+    // every simulation adds one visit to a root child
+    REQUIRE(searcher.getStats().total_visits ==
+            searcher.getStats().reused_visits + searcher.getStats().n_simulations);
+  }
+
+  searcher.resetTree();
+  requireSoundSearch(searcher, game.back(), searcher.getBestMove(game.back()));
+  REQUIRE(searcher.getStats().reused_visits == 0);
+}
+
+TEST_CASE("test GumbelMCTS shares transpositions instead of evaluating them", "[search]") {
+  ZobristHash::initialiseKeys();
+  DummyNet net;
+  GumbelMCTS searcher(&net, 400);
+  // the rook and king reach the same squares in many orders
+  Position pos("7k/8/8/8/8/8/8/KR6 w - - 0 1");
+  requireSoundSearch(searcher, pos, searcher.getBestMove(pos));
+  const SearchStats& stats = searcher.getStats();
+  REQUIRE(stats.n_transpositions > 0);
+  REQUIRE(stats.nn_evaluations <= stats.n_expansions - stats.n_transpositions);
+}
+
+TEST_CASE("test GumbelMCTS tree parallel search", "[search]") {
+  ZobristHash::initialiseKeys();
+  SearchOptions options;
+  options.n_threads = 4;
+  DummyNet net;
+  GumbelMCTS searcher(&net, 200, nullptr, options);
+  Position start;
+  requireSoundSearch(searcher, start, searcher.getBestMove(start));
+
+  // with only two children and a slow net the threads keep arriving at
+  // leaves another thread is still evaluating
+  SlowNet slow_net;
+  GumbelMCTS slow_searcher(&slow_net, 100, nullptr, options);
+  Position pos("k7/8/8/8/8/8/r7/6K1 w - - 0 1");
+  requireSoundSearch(slow_searcher, pos, slow_searcher.getBestMove(pos));
+  REQUIRE(slow_searcher.getStats().n_collisions > 0);
+}
+
+TEST_CASE("test GumbelMCTS tree parallel search under contention", "[search]") {
+  ZobristHash::initialiseKeys();
+  DummyNet net;
+  // with eight threads, expanded nodes whose first simulations are still in
+  // flight have no visits yet and still have to be selected through
+  for (int batch_size : {1, 8}) {
+    SearchOptions options;
+    options.n_threads = 8;
+    options.batch_size = batch_size;
+    for (const char* fen : {"7k/8/8/8/8/8/8/KR6 w - - 0 1", "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"}) {
+      Position pos(fen);
+      for (int i = 0; i < 5; i++) {
+        GumbelMCTS searcher(&net, 400, nullptr, options);
+        requireSoundSearch(searcher, pos, searcher.getBestMove(pos));
+      }
+    }
+  }
+}
+
+TEST_CASE("test GumbelMCTS root parallel search", "[search]") {
+  ZobristHash::initialiseKeys();
+  SearchOptions options;
+  options.n_threads = 4;
+  options.root_parallel = true;
+  DummyNet net;
+  GumbelMCTS searcher(&net, 200, nullptr, options);
+  Position start;
+  requireSoundSearch(searcher, start, searcher.getBestMove(start));
+
+  // unlike the tree parallel search above, each subtree only ever has one
+  // thread in it so nothing collides
+  SlowNet slow_net;
+  GumbelMCTS slow_searcher(&slow_net, 100, nullptr, options);
+  Position pos("k7/8/8/8/8/8/r7/6K1 w - - 0 1");
+  requireSoundSearch(slow_searcher, pos, slow_searcher.getBestMove(pos));
+  REQUIRE(slow_searcher.getStats().n_collisions == 0);
+}
+
+TEST_CASE("test GumbelMCTS evaluates leaves in batches", "[search]") {
+  ZobristHash::initialiseKeys();
+  SearchOptions options;
+  options.batch_size = 8;
+  BatchRecordingNet net;
+  GumbelMCTS searcher(&net, 200, nullptr, options);
+  Position start;
+  requireSoundSearch(searcher, start, searcher.getBestMove(start));
+  const SearchStats& stats = searcher.getStats();
+  REQUIRE(stats.n_batches < stats.nn_evaluations);
+  REQUIRE(stats.averageBatchSize() > 1);
+  REQUIRE(net.largest_batch > 1);
+  REQUIRE(net.largest_batch <= options.batch_size);
+}
+
+TEST_CASE("test GumbelMCTS retries suspended simulations that collide", "[search]") {
+  ZobristHash::initialiseKeys();
+  DummyNet net;
+  // with only two children, simulations in the same batch keep running into
+  // leaves an earlier one is suspended on. they have to be retried after the
+  // batch, on one thread or several
+  Position pos("k7/8/8/8/8/8/r7/6K1 w - - 0 1");
+  for (int n_threads : {1, 4}) {
+    SearchOptions options;
+    options.n_threads = n_threads;
+    options.batch_size = 8;
+    GumbelMCTS searcher(&net, 200, nullptr, options);
+    requireSoundSearch(searcher, pos, searcher.getBestMove(pos));
+    REQUIRE(searcher.getStats().n_collisions > 0);
+    REQUIRE(searcher.getStats().n_batches < searcher.getStats().nn_evaluations);
+  }
+}
+
+TEST_CASE("test GumbelMCTS runs narrow lines to terminal positions", "[search]") {
+  ZobristHash::initialiseKeys();
+  // a peaked policy sends every simulation down the same line, which ends
+  // in a fifty move draw a few plies below the root
+  PeakedNet net;
+  GumbelMCTS searcher(&net, 400);
+  Position pos("7k/8/8/8/8/8/8/KR6 w - - 90 1");
+  Move best_move = searcher.getBestMove(pos);
+  requireSoundSearch(searcher, pos, best_move);
+}
+
+TEST_CASE("test GumbelMCTS timed search ends close to its deadline", "[search]") {
+  ZobristHash::initialiseKeys();
+  SlowNet net;
+  GumbelMCTS searcher(&net, 0);
+  Position start;
+  // 16 candidates at 1 ms each, so a round that finished its chunk before
+  // checking the clock would overshoot by much more than this
+  Move best_move = searcher.getBestMove(start, std::chrono::milliseconds(50));
+  requireSoundSearch(searcher, start, best_move);
+  REQUIRE(searcher.getStats().deadline_overshoot_seconds < 0.01);
+
+  // a budget too short for every candidate to get its first visit
+  best_move = searcher.getBestMove(start, std::chrono::milliseconds(5));
+  REQUIRE(isLegal(start, best_move));
+  REQUIRE(searcher.getStats().deadline_overshoot_seconds < 0.01);
+}
+
+TEST_CASE("test GumbelMCTS stops soon after stop()", "[search]") {
+  ZobristHash::initialiseKeys();
+  DummyNet net;
+  Position start;
+  SearchOptions tree_parallel_batched;
+  tree_parallel_batched.n_threads = 4;
+  tree_parallel_batched.batch_size = 8;
+  for (const SearchOptions& options : {SearchOptions(), tree_parallel_batched}) {
+    GumbelMCTS searcher(&net, 200, nullptr, options);
+    Move best_move;
+    // searches until stopped, as go infinite does
+    std::thread search_thread([&] { best_move = searcher.getBestMove(start, std::chrono::hours(1)); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    SearchClock::time_point stopped = SearchClock::now();
+    searcher.stop();
+    search_thread.join();
+    REQUIRE(SearchClock::now() - stopped < std::chrono::milliseconds(50));
+    requireSoundSearch(searcher, start, best_move);
+
+    // the stop holds until it's cleared
+    searcher.getBestMove(start);
+    REQUIRE(searcher.getStats().n_simulations == 0);
+    searcher.clearStop();
+  }
+}
+
+TEST_CASE("test GumbelMCTS reuses the subtree of the expected reply", "[search]") {
+  ZobristHash::initialiseKeys();
+  DummyNet net;
+  GumbelMCTS searcher(&net, 200);
+  std::deque<Position> game;
+  game.emplace_back();
+  Move move = searcher.getBestMove(game.back());
+  std::optional<Move> reply = searcher.getExpectedReply(move);
+  REQUIRE(reply);
+  game.push_back(game.back().applyMove(move));
+  game.push_back(game.back().applyMove(*reply));
+
+  Move next_move = searcher.getBestMove(game.back());
+  REQUIRE(isLegal(game.back(), next_move));
+  REQUIRE(searcher.getStats().reused_visits > 0);
+  // every simulation adds one visit to a root child
+  REQUIRE(searcher.getStats().total_visits ==
+          searcher.getStats().reused_visits + searcher.getStats().n_simulations);
+}
+
+TEST_CASE("test GumbelMCTS returns the null move when there are no legal moves", "[search]") {
+  ZobristHash::initialiseKeys();
+  DummyNet net;
+  GumbelMCTS searcher(&net, 50);
+  // fool's mate
+  Position mated("rnb1kbnr/pppp1ppp/8/4p3/6Pq/5P2/PPPPP2P/RNBQKBNR w KQkq - 1 3");
+  Move move = searcher.getBestMove(mated);
+  REQUIRE(move.source == move.dest);
+  REQUIRE(searcher.getStats().n_simulations == 0);
+  move = searcher.getBestMove(mated, std::chrono::milliseconds(20));
+  REQUIRE(move.source == move.dest);
+}
+
+TEST_CASE("test GumbelMCTS plays a move from a drawn root", "[search]") {
+  ZobristHash::initialiseKeys();
+  DummyNet net;
+  GumbelMCTS searcher(&net, 50);
+  // insufficient material and the fifty move rule
+  for (const char* fen : {"8/8/8/4k3/8/8/8/K7 w - - 0 1", "8/8/8/4k3/8/8/1R6/K7 w - - 100 80"}) {
+    Position pos(fen);
+    REQUIRE(pos.isDraw());
+    requireSoundSearch(searcher, pos, searcher.getBestMove(pos));
+  }
+
+  // threefold repetition. black only has two moves before the last one, so
+  // the previous search expanded the drawn position as a leaf of its tree
+  std::deque<Position> game;
+  game.emplace_back("k7/8/1K6/8/8/8/8/7R w - - 0 1");
+  for (int i = 0; i < 2; i++) {
+    for (const std::string& uci : {"h1h2", "a8b8", "h2h1", "b8a8"}) {
+      searcher.getBestMove(game.back());
+      MoveGenerator move_gen;
+      for (const Move& move : move_gen.generateMoves(game.back())) {
+        if (move.toUCI() == uci) {
+          game.push_back(game.back().applyMove(move));
+          break;
+        }
+      }
+    }
+  }
+  REQUIRE(game.size() == 9);
+  REQUIRE(game.back().isDraw());
+  Move best_move = searcher.getBestMove(game.back());
+  REQUIRE(isLegal(game.back(), best_move));
+  REQUIRE(searcher.getStats().n_simulations > 0);
+}
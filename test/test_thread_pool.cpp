@@ -0,0 +1,38 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <atomic>
+#include <set>
+#include <vector>
+
+#include "thread_pool.h"
+
+TEST_CASE("test ThreadPool runs every task once", "[thread_pool]") {
+  ThreadPool pool(4);
+  REQUIRE(pool.size() == 4);
+
+  std::vector<std::atomic<int>> n_runs(1000);
+  std::atomic<bool> bad_thread_index = false;
+  pool.run(n_runs.size(), [&](int task, int thread_index) {
+    n_runs[task]++;
+    if (thread_index < 0 || thread_index >= pool.size()) {
+      bad_thread_index = true;
+    }
+  });
+
+  for (const std::atomic<int>& n : n_runs) {
+    REQUIRE(n == 1);
+  }
+  REQUIRE(!bad_thread_index);
+}
+
+TEST_CASE("test ThreadPool run is a barrier", "[thread_pool]") {
+  ThreadPool pool(3);
+  std::atomic<int> n_done = 0;
+  for (int batch = 1; batch <= 20; batch++) {
+    pool.run(batch, [&](int, int) { n_done++; });
+    // every task of the batch has finished by the time run returns
+    REQUIRE(n_done == batch * (batch + 1) / 2);
+  }
+  pool.run(0, [&](int, int) { n_done++; });
+  REQUIRE(n_done == 210);
+}
@@ -0,0 +1,276 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "move_generator.h"
+#include "net.h"
+#include "uci.h"
+#include "useful_fens.h"
+#include "zobrist_hash.h"
+
+// collects the engine's output so tests can read it while the search
+// threads are still writing
+class LockedStringBuf : public std::streambuf {
+  public:
+    std::string str() const {
+      std::lock_guard<std::mutex> lock(mutex);
+      return text;
+    }
+
+  protected:
+    int_type overflow(int_type ch) override {
+      if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+        std::lock_guard<std::mutex> lock(mutex);
+        text += traits_type::to_char_type(ch);
+      }
+      return traits_type::not_eof(ch);
+    }
+    std::streamsize xsputn(const char* s, std::streamsize count) override {
+      std::lock_guard<std::mutex> lock(mutex);
+      text.append(s, count);
+      return count;
+    }
+
+  private:
+    mutable std::mutex mutex;
+    std::string text;
+};
+
+class LockedStream : public std::ostream {
+  public:
+    LockedStream() : std::ostream(&buf) {}
+    std::string str() const { return buf.str(); }
+
+  private:
+    LockedStringBuf buf;
+};
+
+// the complete lines of out starting with prefix
+std::vector<std::string> getLines(const LockedStream& out, const std::string& prefix) {
+  std::istringstream in(out.str());
+  std::vector<std::string> lines;
+  std::string line;
+  while (std::getline(in, line) && !in.eof()) {
+    if (line.starts_with(prefix)) {
+      lines.push_back(line);
+    }
+  }
+  return lines;
+}
+
+TEST_CASE("test parseUCIMove()", "[uci]") {
+  ZobristHash::initialiseKeys();
+  MoveGenerator move_gen;
+  Position pos(tricky_position);
+  std::optional<Move> castle = parseUCIMove(move_gen, pos, "e1g1");
+  REQUIRE(castle);
+  REQUIRE(castle->move_type == MoveType::KingsideCastle);
+  REQUIRE(parseUCIMove(move_gen, pos, "d5e6"));
+  // no piece on e2 can get to e4
+  REQUIRE(!parseUCIMove(move_gen, pos, "e2e4"));
+  REQUIRE(!parseUCIMove(move_gen, pos, "nonsense"));
+}
+
+TEST_CASE("test UCIEngine position command", "[uci]") {
+  ZobristHash::initialiseKeys();
+  DummyNet net;
+  LockedStream out;
+  UCIEngine engine(&net, out);
+
+  engine.handleCommand("position startpos moves e2e4 e7e5 g1f3");
+  REQUIRE(engine.getGame().size() == 4);
+  REQUIRE(engine.getGame().back().getSideToMove() == Colour::Black);
+  REQUIRE(engine.getGame().back().getHash() ==
+          Position("rnbqkbnr/pppp1ppp/8/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R b KQkq - 1 2").getHash());
+
+  engine.handleCommand("position fen " + tricky_position + "moves e1c1");
+  REQUIRE(engine.getGame().size() == 2);
+  REQUIRE(engine.getGame().back().getSideToMove() == Colour::Black);
+
+  // the game stops at an illegal move
+  engine.handleCommand("position startpos moves e2e4 e2e4");
+  REQUIRE(engine.getGame().size() == 2);
+  REQUIRE(getLines(out, "info string illegal move").size() == 1);
+}
+
+TEST_CASE("test UCIEngine go movetime plays a legal move", "[uci]") {
+  ZobristHash::initialiseKeys();
+  DummyNet net;
+  LockedStream out;
+  UCIEngine engine(&net, out);
+
+  engine.handleCommand("uci");
+  REQUIRE(getLines(out, "uciok").size() == 1);
+  engine.handleCommand("position startpos moves e2e4");
+  engine.handleCommand("go movetime 100");
+  engine.waitForSearch();
+
+  std::vector<std::string> best_moves = getLines(out, "bestmove ");
+  REQUIRE(best_moves.size() == 1);
+  MoveGenerator move_gen;
+  REQUIRE(parseUCIMove(move_gen, engine.getGame().back(), best_moves[0].substr(9)));
+}
+
+TEST_CASE("test UCIEngine answers isready and stop during go infinite", "[uci]") {
+  ZobristHash::initialiseKeys();
+  DummyNet net;
+  LockedStream out;
+  UCIEngine engine(&net, out);
+
+  engine.handleCommand("debug on");
+  engine.handleCommand("go infinite");
+  engine.handleCommand("isready");
+  REQUIRE(getLines(out, "readyok").size() == 1);
+  engine.handleCommand("stop");
+  engine.waitForSearch();
+  REQUIRE(getLines(out, "bestmove ").size() == 1);
+  REQUIRE(getLines(out, "info string stop latency").size() == 1);
+
+  REQUIRE(!engine.handleCommand("quit"));
+}
+
+TEST_CASE("test UCIEngine go infinite waits for stop with a single legal move", "[uci]") {
+  ZobristHash::initialiseKeys();
+  DummyNet net;
+  LockedStream out;
+  UCIEngine engine(&net, out);
+
+  // Kg1 is white's only move so the search has nothing to do
+  engine.handleCommand("position fen k7/8/8/8/8/8/r7/7K w - - 0 1");
+  engine.handleCommand("go infinite");
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  REQUIRE(getLines(out, "bestmove ").empty());
+  engine.handleCommand("stop");
+  engine.waitForSearch();
+  std::vector<std::string> best_moves = getLines(out, "bestmove ");
+  REQUIRE(best_moves.size() == 1);
+  REQUIRE(best_moves[0].starts_with("bestmove h1g1"));
+
+  // quit releases it too
+  engine.handleCommand("go infinite");
+  REQUIRE(!engine.handleCommand("quit"));
+  REQUIRE(getLines(out, "bestmove ").size() == 2);
+}
+
+TEST_CASE("test UCIEngine go without a time limit still ends by itself", "[uci]") {
+  ZobristHash::initialiseKeys();
+  DummyNet net;
+  LockedStream out;
+  UCIEngine engine(&net, out);
+
+  // only go infinite and go ponder hold their bestmove until stop
+  engine.handleCommand("position fen k7/8/8/8/8/8/r7/7K w - - 0 1");
+  size_t n_searches = 0;
+  for (const std::string& command : {"go depth 3", "go nodes 1000", "go mate 2", "go"}) {
+    engine.handleCommand(command);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    REQUIRE(getLines(out, "bestmove h1g1").size() == ++n_searches);
+    engine.waitForSearch();
+  }
+
+  // with moves to search it stops after the default movetime
+  engine.handleCommand("position startpos");
+  engine.handleCommand("go depth 3");
+  engine.waitForSearch();
+  REQUIRE(getLines(out, "bestmove ").size() == ++n_searches);
+}
+
+TEST_CASE("test UCIEngine reports no move when mated", "[uci]") {
+  ZobristHash::initialiseKeys();
+  DummyNet net;
+  LockedStream out;
+  UCIEngine engine(&net, out);
+
+  engine.handleCommand("position startpos moves f2f3 e7e5 g2g4 d8h4");
+  engine.handleCommand("go movetime 100");
+  engine.waitForSearch();
+  REQUIRE(getLines(out, "bestmove 0000").size() == 1);
+
+  // stalemate, and go infinite still waits for stop
+  engine.handleCommand("position fen k7/8/1Q6/8/8/8/8/7K b - - 0 1");
+  engine.handleCommand("go infinite");
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  REQUIRE(getLines(out, "bestmove ").size() == 1);
+  engine.handleCommand("stop");
+  engine.waitForSearch();
+  REQUIRE(getLines(out, "bestmove 0000").size() == 2);
+  REQUIRE(out.str().find("a1a1") == std::string::npos);
+}
+
+TEST_CASE("test UCIEngine ponderhit turns pondering into the next search", "[uci]") {
+  ZobristHash::initialiseKeys();
+  DummyNet net;
+  LockedStream out;
+  UCIEngine engine(&net, out);
+
+  engine.handleCommand("setoption name Ponder value true");
+  engine.handleCommand("position startpos");
+  engine.handleCommand("go movetime 100");
+  engine.waitForSearch();
+  std::vector<std::string> best_moves = getLines(out, "bestmove ");
+  REQUIRE(best_moves.size() == 1);
+  // bestmove e2e4 ponder e7e5
+  std::istringstream best_move(best_moves[0]);
+  std::string token, move, ponder, reply;
+  best_move >> token >> move >> ponder >> reply;
+  REQUIRE(ponder == "ponder");
+
+  engine.handleCommand("position startpos moves " + move + " " + reply);
+  engine.handleCommand("go ponder movetime 100");
+  // nothing is played while pondering
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  REQUIRE(getLines(out, "bestmove ").size() == 1);
+  engine.handleCommand("ponderhit");
+  engine.waitForSearch();
+  REQUIRE(getLines(out, "bestmove ").size() == 2);
+}
+
+TEST_CASE("test UCIEngine stop while pondering still plays a move", "[uci]") {
+  ZobristHash::initialiseKeys();
+  DummyNet net;
+  LockedStream out;
+  UCIEngine engine(&net, out);
+
+  engine.handleCommand("position startpos moves e2e4 e7e5");
+  engine.handleCommand("go ponder wtime 1000 btime 1000");
+  engine.handleCommand("stop");
+  engine.waitForSearch();
+  REQUIRE(getLines(out, "bestmove ").size() == 1);
+  // a ponderhit after the search has stopped is ignored
+  engine.handleCommand("ponderhit");
+  engine.waitForSearch();
+  REQUIRE(getLines(out, "bestmove ").size() == 1);
+}
+
+TEST_CASE("test UCIEngine go ponder waits with a single legal move", "[uci]") {
+  ZobristHash::initialiseKeys();
+  DummyNet net;
+  LockedStream out;
+  UCIEngine engine(&net, out);
+
+  // Kg1 is white's only move so the search has nothing to do
+  engine.handleCommand("position fen k7/8/8/8/8/8/r7/7K w - - 0 1");
+  engine.handleCommand("go ponder movetime 100");
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  REQUIRE(getLines(out, "bestmove ").empty());
+  // the search after ponderhit is timed so it plays straight away
+  engine.handleCommand("ponderhit");
+  engine.waitForSearch();
+  std::vector<std::string> best_moves = getLines(out, "bestmove ");
+  REQUIRE(best_moves.size() == 1);
+  REQUIRE(best_moves[0].starts_with("bestmove h1g1"));
+
+  engine.handleCommand("go ponder movetime 100");
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  REQUIRE(getLines(out, "bestmove ").size() == 1);
+  engine.handleCommand("stop");
+  engine.waitForSearch();
+  REQUIRE(getLines(out, "bestmove ").size() == 2);
+}